@@ -0,0 +1,401 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   expand.c  -  Word expansion and quote removal
+ *
+ *   Turns a word as it was typed into the argument it stands for, in a
+ *   single pass over the word:
+ *	~ and ~user at the start of the word	the home directory
+ *	$NAME and ${NAME}			the environment variable, or nothing
+ *	$?					the exit status of the last line
+ *	$$					the pid of the shell
+ *	'...'					taken as it is
+ *	"..."					$ expansions only, \ escapes $ " \
+ *	\c					c, outside of quotes
+ *   The value of a variable is not split into several words. Nothing is
+ *   forked, and a word without any of ~ $ ' " \ is returned as it is,
+ *   without allocating anything.
+ *
+ *   Alongside the word, a glob pattern is built in which every quoted
+ *   * ? [ ] and \ is escaped with a \, for words with an unquoted * ? or [
+ *   to be handed to yglob_expand().
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pwd.h>
+#include "parse.h"
+#include "stats.h"
+#include "expand.h"
+
+struct homeCache {		       /* a ~user looked up earlier */
+  char *user;
+  char *home;			       /* NULL if there is no such user */
+  struct homeCache *next;
+};
+
+static struct homeCache *homes = NULL;
+static int lastStatus = 0;
+
+struct buffer {			       /* reused from word to word */
+  char *s;
+  size_t len;
+  size_t size;
+};
+
+static struct buffer out = { NULL, 0, 0 };     /* the word being built */
+static struct buffer pat = { NULL, 0, 0 };     /* and its glob pattern */
+static int globbing = 0;	       /* an unquoted * ? or [ was seen */
+
+
+/* -----------------------------------------------------------------------------
+expand_set_status()
+DESCRIPTION:  Sets what $? expands to.
+-------------------------------------------------------------------------------*/
+void expand_set_status( int status )
+{
+  lastStatus = status;
+}
+
+
+/* -----------------------------------------------------------------------------
+append()
+DESCRIPTION:  Adds len bytes of s to b.
+-------------------------------------------------------------------------------*/
+static void append( struct buffer *b, const char *s, size_t len )
+{
+  if( b->len + len + 1 > b->size )
+  {
+	size_t size = b->size ? b->size : 256;
+	char *grown;
+
+	while( b->len + len + 1 > size )
+	  size *= 2;
+	grown = stat_alloc( realloc( b->s, size ) );
+	if( grown == NULL )
+	  return;
+	b->s = grown;
+	b->size = size;
+  }
+  memcpy( b->s + b->len, s, len );
+  b->len += len;
+}
+
+
+/* -----------------------------------------------------------------------------
+emit()
+DESCRIPTION:  Adds len bytes of s to the word being built, and to its glob
+pattern, escaped there if they were quoted.
+-------------------------------------------------------------------------------*/
+static void emit( const char *s, size_t len, int quoted )
+{
+  size_t i, start = 0;
+
+  append( &out, s, len );
+  if( !quoted )
+  {
+	append( &pat, s, len );
+	for( i = 0; i < len && !globbing; i++ )
+	  globbing = s[i] == '*' || s[i] == '?' || s[i] == '[';
+	return;
+  }
+  for( i = 0; i < len; i++ )
+	if( strchr( "*?[]\\", s[i] ) != NULL )
+	{
+	  append( &pat, s + start, i - start );
+	  append( &pat, "\\", 1 );
+	  start = i;
+	}
+  append( &pat, s + start, len - start );
+}
+
+
+/* -----------------------------------------------------------------------------
+home_of()
+DESCRIPTION:  The home directory of the user named by the len bytes at
+user, or of the shell's user when len is 0. getpwnam() is only asked about
+a user once per session.
+-------------------------------------------------------------------------------*/
+static const char *home_of( const char *user, size_t len )
+{
+  struct homeCache *c;
+  struct passwd *pw;
+
+  if( len == 0 )
+  {
+	const char *home = getenv( "HOME" );
+
+	if( home != NULL )
+	  return home;
+	pw = getpwuid( getuid() );
+	return pw ? pw->pw_dir : NULL;
+  }
+
+  for( c = homes; c != NULL; c = c->next )
+	if( strncmp( c->user, user, len ) == 0 && c->user[len] == '\0' )
+	  return c->home;
+
+  c = stat_alloc( malloc( sizeof(struct homeCache) ) );
+  if( c == NULL || (c->user = stat_alloc( strndup( user, len ) )) == NULL )
+  {
+	free( c );
+	return NULL;
+  }
+  pw = getpwnam( c->user );
+  c->home = pw ? stat_alloc( strdup( pw->pw_dir ) ) : NULL;
+  c->next = homes;
+  homes = c;
+  return c->home;
+}
+
+
+/* -----------------------------------------------------------------------------
+is_name_char()
+DESCRIPTION:  Whether c may appear in a variable name after its first
+character.
+-------------------------------------------------------------------------------*/
+static int is_name_char( char c )
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	 (c >= '0' && c <= '9') || c == '_';
+}
+
+
+/* -----------------------------------------------------------------------------
+dollar()
+DESCRIPTION:  Expands the $ at p, inside double quotes if quoted is set,
+and returns the first character after what it used up. A $ that starts no
+expansion is kept as it is.
+-------------------------------------------------------------------------------*/
+static const char *dollar( const char *p, int quoted )
+{
+  char buf[24];
+  const char *name, *end, *value;
+  char *copy;
+
+  if( p[1] == '?' || p[1] == '$' )
+  {
+	emit( buf, snprintf( buf, sizeof(buf), "%d", p[1] == '?' ? lastStatus : (int) getpid() ),
+	      quoted );
+	return p + 2;
+  }
+  if( p[1] == '{' )
+  {
+	name = p + 2;
+	end = strchr( name, '}' );
+	if( end == NULL )	       /* ${ without its }, not an expansion */
+	{
+	  emit( p, 1, quoted );
+	  return p + 1;
+	}
+  }
+  else
+  {
+	name = p + 1;
+	if( !is_name_char( *name ) || (*name >= '0' && *name <= '9') )
+	{
+	  emit( p, 1, quoted );
+	  return p + 1;
+	}
+	for( end = name; is_name_char( *end ); end++ );
+  }
+
+  copy = stat_alloc( strndup( name, end - name ) );
+  value = copy ? getenv( copy ) : NULL;
+  free( copy );
+  if( value != NULL )
+	emit( value, strlen( value ), quoted );
+  return *end == '}' && p[1] == '{' ? end + 1 : end;
+}
+
+
+/* -----------------------------------------------------------------------------
+expand_word()
+DESCRIPTION:  Returns the expansion of word, allocated from arena, or word
+itself when there is nothing to expand. *removed is set when the word
+vanishes altogether, which is when it was made only of expansions that
+came out empty, and nothing quoted: echo $UNSET gets no argument, while
+echo "$UNSET" gets an empty one. Unless pattern is NULL, *pattern is set to
+the glob pattern of the word if it has unquoted wildcards, or else to NULL.
+-------------------------------------------------------------------------------*/
+char *expand_word( char *word, parseArena *arena, int *removed, char **pattern )
+{
+  const char *p = word, *start;
+  int quoted = 0;
+  char *result;
+
+  *removed = 0;
+  if( pattern != NULL )
+	*pattern = NULL;
+  if( word[0] != '~' && strpbrk( word, "$'\"\\" ) == NULL )
+  {
+	if( pattern != NULL && strpbrk( word, "*?[" ) != NULL )
+	  *pattern = word;
+	return word;
+  }
+
+  out.len = 0;
+  pat.len = 0;
+  globbing = 0;
+  if( *p == '~' )
+  {
+	const char *home;
+
+	for( start = ++p; *p != '\0' && *p != '/'; p++ );
+	home = home_of( start, p - start );
+	if( home != NULL && strcspn( start, "$'\"\\" ) >= (size_t) (p - start) )
+	  emit( home, strlen( home ), 1 );
+	else			       /* an unknown user, or a quoted name */
+	  p = start - 1;
+  }
+
+  while( *p != '\0' )
+  {
+	switch( *p )
+	{
+	  case '\'':
+		quoted = 1;
+		start = ++p;
+		while( *p != '\0' && *p != '\'' )
+		  p++;
+		emit( start, p - start, 1 );
+		if( *p == '\'' )
+		  p++;
+		break;
+	  case '"':
+		quoted = 1;
+		p++;
+		while( *p != '\0' && *p != '"' )
+		{
+		  if( *p == '\\' && (p[1] == '$' || p[1] == '"' || p[1] == '\\' || p[1] == '`') )
+		  {
+			emit( p + 1, 1, 1 );
+			p += 2;
+		  }
+		  else if( *p == '$' )
+			p = dollar( p, 1 );
+		  else
+			emit( p++, 1, 1 );
+		}
+		if( *p == '"' )
+		  p++;
+		break;
+	  case '\\':
+		quoted = 1;
+		if( p[1] != '\0' )
+		  p++;
+		emit( p++, 1, 1 );
+		break;
+	  case '$':
+		p = dollar( p, 0 );
+		break;
+	  default:
+		for( start = p; *p != '\0' && strchr( "'\"\\$", *p ) == NULL; p++ );
+		emit( start, p - start, 0 );
+		break;
+	}
+  }
+
+  if( out.len == 0 && !quoted )
+  {
+	*removed = 1;
+	return word;
+  }
+  result = arena_alloc( arena, out.len + 1 );
+  if( result == NULL )
+	return word;
+  memcpy( result, out.s ? out.s : "", out.len );
+  result[out.len] = '\0';
+
+  if( pattern != NULL && globbing )
+  {
+	if( pat.len == out.len )       /* nothing quoted needed escaping */
+	  *pattern = result;
+	else if( (*pattern = arena_alloc( arena, pat.len + 1 )) != NULL )
+	{
+	  memcpy( *pattern, pat.s, pat.len );
+	  (*pattern)[pat.len] = '\0';
+	}
+  }
+  return result;
+}
+
+
+/* -----------------------------------------------------------------------------
+expand_delimiter()
+DESCRIPTION:  The delimiter of a here-document as it is to be matched: word
+with its quotes and backslashes removed, but nothing expanded. *quoted is
+set when there were any, which means the body is not expanded either.
+-------------------------------------------------------------------------------*/
+char *expand_delimiter( char *word, parseArena *arena, int *quoted )
+{
+  const char *p = word;
+  char *result;
+  char q = 0;			       /* the quote we are in, if any */
+
+  *quoted = strpbrk( word, "'\"\\" ) != NULL;
+  if( !*quoted )
+	return word;
+  out.len = 0;
+  for( ; *p != '\0'; p++ )
+  {
+	if( q == 0 && (*p == '\'' || *p == '"') )
+	  q = *p;
+	else if( *p == q )
+	  q = 0;
+	else if( *p == '\\' && q != '\'' && p[1] != '\0' )
+	  append( &out, ++p, 1 );
+	else
+	  append( &out, p, 1 );
+  }
+  result = arena_alloc( arena, out.len + 1 );
+  if( result == NULL )
+	return word;
+  memcpy( result, out.s ? out.s : "", out.len );
+  result[out.len] = '\0';
+  return result;
+}
+
+
+/* -----------------------------------------------------------------------------
+expand_heredoc()
+DESCRIPTION:  Expands the body of a here-document whose delimiter was not
+quoted: $ expansions are done, a backslash only escapes $ ` \ and newline,
+and quotes are ordinary characters. Returns body itself when there is nothing
+to expand.
+-------------------------------------------------------------------------------*/
+char *expand_heredoc( char *body, parseArena *arena )
+{
+  const char *p = body, *start;
+  char *result;
+
+  if( strpbrk( body, "$\\" ) == NULL )
+	return body;
+  out.len = 0;
+  pat.len = 0;
+  while( *p != '\0' )
+  {
+	if( *p == '\\' && (p[1] == '$' || p[1] == '`' || p[1] == '\\' || p[1] == '\n') )
+	{
+	  if( p[1] != '\n' )
+		emit( p + 1, 1, 1 );
+	  p += 2;
+	}
+	else if( *p == '$' )
+	  p = dollar( p, 1 );
+	else
+	{
+	  for( start = p++; *p != '\0' && *p != '$' && *p != '\\'; p++ );
+	  emit( start, p - start, 1 );
+	}
+  }
+  result = arena_alloc( arena, out.len + 1 );
+  if( result == NULL )
+	return body;
+  memcpy( result, out.s ? out.s : "", out.len );
+  result[out.len] = '\0';
+  return result;
+}
@@ -0,0 +1,7 @@
+/* word expansion and quote removal, see expand.c */
+
+/* the function prototypes */
+char *expand_word(char *, parseArena *, int *, char **);
+char *expand_delimiter(char *, parseArena *, int *);
+char *expand_heredoc(char *, parseArena *);
+void expand_set_status(int);
@@ -0,0 +1,298 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   fdcopy.c  -  Moving data between descriptors without a user buffer
+ *
+ *   Copies everything left on one descriptor to another with whichever
+ *   call the kernel can do it with, so the data never passes through the
+ *   shell: copy_file_range between two regular files (which may share
+ *   the blocks on filesystems that can), splice when either side is a
+ *   pipe, and sendfile from a regular file to anything else. A call the
+ *   kernel refuses for this pair of descriptors hands over to the next
+ *   one, from where the last left off, and read and write into a buffer
+ *   is the last resort.
+ *
+ *   The pump of a |& group copies one pipe into several: tee duplicates
+ *   the data waiting in the source pipe into every consumer's pipe but
+ *   the last without consuming it, and splice then moves it into the
+ *   last one.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "stats.h"
+#include "fdcopy.h"
+
+#define CHUNK (1 << 30)		       /* asked for per call, well below SSIZE_MAX */
+#define PIPE_CHUNK (1 << 20)	       /* no more than a pipe can be made to hold */
+#define BUFFER_SIZE (128 * 1024)
+
+enum copyMethods {
+  COPY_RANGE,
+  COPY_SPLICE,
+  COPY_SENDFILE,
+  COPY_READ
+};
+
+
+/* -----------------------------------------------------------------------------
+refused()
+DESCRIPTION:  Whether errno means that the call cannot copy between these two
+kinds of descriptors, rather than that the copy itself went wrong.
+-------------------------------------------------------------------------------*/
+static int refused( int err )
+{
+  return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+	 err == EBADF || err == ESPIPE;
+}
+
+
+/* -----------------------------------------------------------------------------
+copy_once()
+DESCRIPTION:  One call of method from in to out. Returns what the call
+returned: the bytes moved, 0 at end of file, or -1 with errno set.
+-------------------------------------------------------------------------------*/
+static ssize_t copy_once( int method, int in, int out, char **buf )
+{
+  ssize_t n;
+
+  switch( method )
+  {
+	case COPY_RANGE:
+	  return copy_file_range( in, NULL, out, NULL, CHUNK, 0 );
+	case COPY_SPLICE:
+	  return splice( in, NULL, out, NULL, PIPE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE );
+	case COPY_SENDFILE:
+	  return sendfile( out, in, NULL, CHUNK );
+  }
+
+  if( *buf == NULL && (*buf = stat_alloc( malloc( BUFFER_SIZE ) )) == NULL )
+	return -1;
+  n = read( in, *buf, BUFFER_SIZE );
+  if( n > 0 && fd_write( out, *buf, n ) == -1 )
+	return -1;
+  return n;
+}
+
+
+/* -----------------------------------------------------------------------------
+fd_copy()
+DESCRIPTION:  Copies from in, from its current offset up to its end of file,
+to out at its current offset, and leaves both offsets after what was copied.
+Returns the number of bytes copied, or -1 with errno set if reading or
+writing failed; some data may have been copied by then.
+-------------------------------------------------------------------------------*/
+ssize_t fd_copy( int in, int out )
+{
+  struct stat inSt, outSt;
+  char *buf = NULL;
+  ssize_t n, total = 0;
+  int method, err;
+
+  if( fstat( in, &inSt ) == -1 || fstat( out, &outSt ) == -1 )
+	return -1;
+  if( S_ISREG( inSt.st_mode ) && S_ISREG( outSt.st_mode ) &&
+      !(fcntl( out, F_GETFL ) & O_APPEND) )
+	method = COPY_RANGE;
+  else if( S_ISFIFO( inSt.st_mode ) || S_ISFIFO( outSt.st_mode ) )
+	method = COPY_SPLICE;
+  else if( S_ISREG( inSt.st_mode ) )
+	method = COPY_SENDFILE;
+  else
+	method = COPY_READ;
+
+  for( ;; )
+  {
+	n = copy_once( method, in, out, &buf );
+	if( n > 0 )
+	{
+	  total += n;
+	  continue;
+	}
+	if( n == 0 )
+	  break;
+	if( errno == EINTR )
+	  continue;
+	if( method == COPY_READ || !refused( errno ) )
+	{
+	  err = errno;
+	  free( buf );
+	  errno = err;
+	  return -1;
+	}
+	/* sendfile needs a regular file to read from, read and write nothing */
+	if( method < COPY_SENDFILE && S_ISREG( inSt.st_mode ) )
+	  method = COPY_SENDFILE;
+	else
+	  method = COPY_READ;
+  }
+  free( buf );
+  return total;
+}
+
+
+/* -----------------------------------------------------------------------------
+discard()
+DESCRIPTION:  Reads and drops len bytes of the pipe in, which has them.
+-------------------------------------------------------------------------------*/
+static void discard( int in, ssize_t len, char *buf )
+{
+  ssize_t n;
+
+  while( len > 0 )
+  {
+	n = read( in, buf, len < BUFFER_SIZE ? len : BUFFER_SIZE );
+	if( n < 0 && errno == EINTR )
+	  continue;
+	if( n <= 0 )
+	  return;
+	len -= n;
+  }
+}
+
+
+/* -----------------------------------------------------------------------------
+fd_fanout()
+DESCRIPTION:  Copies everything that comes out of the pipe in into each of
+the n pipes in outs, until in reaches end of file, and then closes in and
+outs. The data is taken in chunks of whatever in holds: tee duplicates a
+chunk into every pipe but the last, and splice moves it into the last one.
+tee cannot start in the middle of a chunk, so when a consumer's pipe only had
+room for part of it, the chunk is read into a buffer instead, and written to
+the last consumer and the rest of it to that one. A consumer that has gone
+away is dropped; once none is left, in is closed so that the producer gets
+SIGPIPE. Returns 0, or -1 with errno set if in could not be read.
+-------------------------------------------------------------------------------*/
+int fd_fanout( int in, int *outs, int n )
+{
+  ssize_t *sent = stat_alloc( malloc( n * sizeof(ssize_t) ) );
+  char *buf = stat_alloc( malloc( BUFFER_SIZE > PIPE_CHUNK ? BUFFER_SIZE : PIPE_CHUNK ) );
+  ssize_t len, got, moved;
+  int i, last, whole, status = 0, err = 0;
+
+  if( sent == NULL || buf == NULL )
+  {
+	err = errno;
+	status = -1;
+  }
+  while( status == 0 && n > 0 )
+  {
+	last = n - 1;
+	if( n == 1 )
+	  len = splice( in, NULL, outs[0], NULL, PIPE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE );
+	else
+	  len = tee( in, outs[0], PIPE_CHUNK, 0 );
+	if( len == 0 )
+	  break;
+	if( len < 0 )
+	{
+	  if( errno == EINTR )
+		continue;
+	  if( errno == EPIPE )
+	  {
+		close( outs[0] );
+		outs[0] = outs[--n];
+		continue;
+	  }
+	  err = errno;
+	  status = -1;
+	  break;
+	}
+	if( n == 1 )
+	  continue;
+
+	sent[0] = len;
+	sent[last] = 0;
+	for( whole = 1, i = 1; i < last; i++ )
+	{
+	  while( (got = tee( in, outs[i], len, 0 )) < 0 && errno == EINTR );
+	  sent[i] = got;
+	  if( got >= 0 && got < len )
+		whole = 0;
+	}
+
+	if( whole )		       /* the last one takes the chunk out of in */
+	{
+	  for( moved = 0; moved < len; moved += got )
+	  {
+		got = splice( in, NULL, outs[last], NULL, len - moved, SPLICE_F_MOVE | SPLICE_F_MORE );
+		if( got < 0 && errno == EINTR )
+		  got = 0;
+		else if( got <= 0 )
+		  break;
+	  }
+	  if( moved < len )
+	  {
+		sent[last] = -1;
+		discard( in, len - moved, buf );
+	  }
+	}
+	else
+	{
+	  for( moved = 0; moved < len; moved += got )
+		if( (got = read( in, buf + moved, len - moved )) <= 0 )
+		{
+		  if( got < 0 && errno == EINTR )
+			got = 0;
+		  else
+			break;
+		}
+	  for( i = 1; i <= last; i++ )
+		if( sent[i] >= 0 && sent[i] < moved &&
+		    fd_write( outs[i], buf + sent[i], moved - sent[i] ) == -1 )
+		  sent[i] = -1;
+	}
+
+	for( i = last; i > 0; i-- )      /* the consumers that went away */
+	  if( sent[i] < 0 )
+	  {
+		close( outs[i] );
+		outs[i] = outs[--n];
+	  }
+  }
+
+  close( in );
+  for( i = 0; i < n; i++ )
+	close( outs[i] );
+  free( sent );
+  free( buf );
+  errno = err;
+  return status;
+}
+
+
+/* -----------------------------------------------------------------------------
+fd_write()
+DESCRIPTION:  Writes all len bytes of buf to fd, going on after short writes
+and interrupted ones. Returns len, or -1 with errno set.
+-------------------------------------------------------------------------------*/
+ssize_t fd_write( int fd, const void *buf, size_t len )
+{
+  const char *p = buf;
+  size_t done = 0;
+  ssize_t n;
+
+  while( done < len )
+  {
+	n = write( fd, p + done, len - done );
+	if( n < 0 && errno == EINTR )
+	  continue;
+	if( n <= 0 )
+	{
+	  if( n == 0 )
+		errno = EIO;
+	  return -1;
+	}
+	done += n;
+  }
+  return len;
+}
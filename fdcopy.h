@@ -0,0 +1,6 @@
+/* copying between descriptors inside the kernel, see fdcopy.c */
+
+/* the function prototypes */
+ssize_t fd_copy(int, int);
+ssize_t fd_write(int, const void *, size_t);
+int fd_fanout(int, int *, int);
@@ -0,0 +1,291 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   hash.c  -  The command path hash table of the shell
+ *
+ *   Remembers where in $PATH every external command was found so that a
+ *   command only pays for the directory walk the first time it is run.
+ *   The table is keyed by command name and uses open addressing with
+ *   linear probing; it is emptied whenever $PATH changes, and single
+ *   entries are dropped when the file they point at disappears.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "stats.h"
+#include "hash.h"
+
+#define HASH_MIN_SIZE 64
+
+static struct hashEntry *table = NULL;
+static size_t tableSize = 0;	       /* always a power of two */
+static size_t tableUsed = 0;
+static char *hashedPath = NULL;	       /* the $PATH the entries were found in */
+
+
+/* -----------------------------------------------------------------------------
+hash_string()
+DESCRIPTION:  FNV-1a hash of a command name
+-------------------------------------------------------------------------------*/
+static size_t hash_string( const char *s )
+{
+  size_t h = 2166136261u;
+
+  while( *s )
+  {
+	h ^= (unsigned char) *s++;
+	h *= 16777619u;
+  }
+  return h;
+}
+
+
+/* -----------------------------------------------------------------------------
+find_slot()
+DESCRIPTION:  Returns the slot holding name, or the empty slot where it
+would be inserted.
+-------------------------------------------------------------------------------*/
+static size_t find_slot( const char *name )
+{
+  size_t i = hash_string( name ) & (tableSize-1);
+
+  while( table[i].name != NULL && strcmp( table[i].name, name ) != 0 )
+	i = (i+1) & (tableSize-1);
+  return i;
+}
+
+
+/* -----------------------------------------------------------------------------
+grow_table()
+DESCRIPTION:  Doubles the table (or creates it) and rehashes every entry.
+Returns 0 if memory ran out, in which case the old table is kept.
+-------------------------------------------------------------------------------*/
+static int grow_table( void )
+{
+  struct hashEntry *old = table;
+  size_t oldSize = tableSize;
+  size_t i;
+
+  tableSize = oldSize ? oldSize*2 : HASH_MIN_SIZE;
+  table = stat_alloc( calloc( tableSize, sizeof(struct hashEntry) ) );
+  if( table == NULL )
+  {
+	table = old;
+	tableSize = oldSize;
+	return 0;
+  }
+  for( i=0; i<oldSize; i++ )
+  {
+	if( old[i].name != NULL )
+		table[find_slot( old[i].name )] = old[i];
+  }
+  free( old );
+  return 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+check_path()
+DESCRIPTION:  Empties the table when $PATH is no longer the one the entries
+were resolved against.
+-------------------------------------------------------------------------------*/
+static void check_path( void )
+{
+  const char *path = getenv( "PATH" );
+
+  if( path == NULL )
+	path = "/usr/bin:/bin";
+  if( hashedPath != NULL && strcmp( hashedPath, path ) == 0 )
+	return;
+
+  hash_clear();
+  free( hashedPath );
+  hashedPath = stat_alloc( strdup( path ) );
+}
+
+
+/* -----------------------------------------------------------------------------
+search_path()
+DESCRIPTION:  Walks hashedPath for an executable regular file called name
+and returns a malloc'd copy of its path, or NULL.
+-------------------------------------------------------------------------------*/
+static char *search_path( const char *name )
+{
+  char candidate[PATH_MAX];
+  const char *dir = hashedPath;
+  struct stat sb;
+
+  while( dir != NULL )
+  {
+	const char *end = strchr( dir, ':' );
+	int len = end ? end-dir : (int) strlen( dir );
+
+	if( len == 0 )		       /* an empty entry means the cwd */
+		snprintf( candidate, sizeof(candidate), "./%s", name );
+	else
+		snprintf( candidate, sizeof(candidate), "%.*s/%s", len, dir, name );
+
+	if( stat( candidate, &sb ) == 0 && S_ISREG( sb.st_mode ) &&
+			access( candidate, X_OK ) == 0 )
+		return stat_alloc( strdup( candidate ) );
+
+	dir = end ? end+1 : NULL;
+  }
+  return NULL;
+}
+
+
+/* -----------------------------------------------------------------------------
+hash_lookup()
+
+DESCRIPTION:  Returns the path to exec for the command name. Names that
+contain a '/' are returned unchanged. Otherwise the cached path is returned,
+searching $PATH and remembering the result on a miss. A path found through a
+relative $PATH entry, such as an empty one, depends on the cwd, so it is
+searched for again every time. Returns NULL if the command cannot be found,
+or if memory ran out with the table full. The string belongs to the table and
+stays valid until the entry is removed.
+-------------------------------------------------------------------------------*/
+char *hash_lookup( const char *name )
+{
+  size_t i = 0;
+  char *path, *copy;
+
+  if( strchr( name, '/' ) != NULL )
+	return (char *) name;
+
+  check_path();
+  if( tableSize != 0 )
+  {
+	i = find_slot( name );
+	if( table[i].name != NULL && table[i].path[0] == '/' )
+	{
+		table[i].hits++;
+		return table[i].path;
+	}
+  }
+
+  path = search_path( name );
+  if( tableSize != 0 && table[i].name != NULL )
+  {				       /* a relative path, checked again */
+	if( path == NULL )
+	{
+		hash_remove( name );
+		return NULL;
+	}
+	table[i].hits++;
+	if( strcmp( path, table[i].path ) == 0 )
+		free( path );	       /* earlier lookups of the line still use it */
+	else
+	{
+		free( table[i].path );
+		table[i].path = path;
+	}
+	return table[i].path;
+  }
+  if( path == NULL )
+	return NULL;
+
+  if( (tableUsed+1)*4 > tableSize*3 && !grow_table() && tableUsed+1 >= tableSize )
+  {
+	free( path );		       /* no memory and no free slot left */
+	return NULL;
+  }
+  copy = stat_alloc( strdup( name ) );
+  if( copy == NULL )
+  {
+	free( path );
+	return NULL;
+  }
+
+  i = find_slot( name );
+  table[i].name = copy;
+  table[i].path = path;
+  table[i].hits = 1;
+  tableUsed++;
+  return path;
+}
+
+
+/* -----------------------------------------------------------------------------
+hash_remove()
+DESCRIPTION:  Forgets the path of name, e.g. after it turned out to be
+stale. Later entries of the probe chain are shifted back so that lookups
+never need tombstones. Returns 1 if there was an entry.
+-------------------------------------------------------------------------------*/
+int hash_remove( const char *name )
+{
+  size_t i, j, home;
+
+  if( tableSize == 0 )
+	return 0;
+  i = find_slot( name );
+  if( table[i].name == NULL )
+	return 0;
+
+  free( table[i].name );
+  free( table[i].path );
+  table[i].name = NULL;
+  tableUsed--;
+
+  for( j = (i+1) & (tableSize-1); table[j].name != NULL; j = (j+1) & (tableSize-1) )
+  {
+	home = hash_string( table[j].name ) & (tableSize-1);
+	/* move j back into the hole unless its home lies cyclically in (i, j] */
+	if( (j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j)) )
+	{
+		table[i] = table[j];
+		table[j].name = NULL;
+		i = j;
+	}
+  }
+  return 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+hash_clear()
+DESCRIPTION:  Forgets every remembered path.
+-------------------------------------------------------------------------------*/
+void hash_clear( void )
+{
+  size_t i;
+
+  for( i=0; i<tableSize; i++ )
+  {
+	if( table[i].name != NULL )
+	{
+		free( table[i].name );
+		free( table[i].path );
+		table[i].name = NULL;
+	}
+  }
+  tableUsed = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+hash_print()
+DESCRIPTION:  Lists the table the way bash's hash builtin does.
+-------------------------------------------------------------------------------*/
+void hash_print( FILE *out )
+{
+  size_t i;
+
+  if( tableUsed == 0 )
+  {
+	fprintf( out, "hash: hash table empty\n" );
+	return;
+  }
+  fprintf( out, "hits\tcommand\n" );
+  for( i=0; i<tableSize; i++ )
+  {
+	if( table[i].name != NULL )
+		fprintf( out, "%4u\t%s\n", table[i].hits, table[i].path );
+  }
+}
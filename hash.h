@@ -0,0 +1,13 @@
+/* command path hash table, see hash.c */
+
+struct hashEntry {
+  char *name;			       /* command name as typed */
+  char *path;			       /* path it resolved to, relative through a relative $PATH entry */
+  unsigned int hits;		       /* number of lookups served */
+};
+
+/* the function prototypes */
+char *hash_lookup(const char *);
+int hash_remove(const char *);
+void hash_clear(void);
+void hash_print(FILE *);
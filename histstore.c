@@ -0,0 +1,267 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   histstore.c  -  The persistent history file of the shell
+ *
+ *   Every line typed at the prompt is appended to a history file as a
+ *   "<time>\t<line>\n" record. Next to it, in <file>.idx, an index holds
+ *   the byte offset of every record as a 64 bit integer, so the number of
+ *   entries is the size of the index and entry n is found without reading
+ *   the ones before it. Both files are only ever appended to, and both are
+ *   read through read-only shared mappings: opening the history costs two
+ *   mmap() calls whatever its size, and the pages of old entries are only
+ *   touched when something asks for them.
+ *
+ *   An index that is missing while the history file is not empty is
+ *   rebuilt from the records, once.
+ *
+ *   Several shells may share one history file without locking it. Each
+ *   record is one write() to a file opened with O_APPEND, so records never
+ *   interleave, and the offset the kernel appended it at is read back from
+ *   the file position. The index entry is written only after the record,
+ *   so every offset another shell finds in the index points at a complete
+ *   record; the index may list concurrent records out of file order, which
+ *   only decides their numbers. A shell picks up what the others wrote by
+ *   reading the index from the last entry it knew.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#define _GNU_SOURCE		       /* memmem(), mremap() */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stats.h"
+#include "histstore.h"
+
+#define RECORD_INLINE_SIZE 1024
+
+struct mapping {
+  int fd;
+  char *map;			       /* NULL while nothing is mapped */
+  size_t mapped;		       /* bytes mapped */
+};
+
+static struct mapping data = { -1, NULL, 0 };
+static struct mapping idx = { -1, NULL, 0 };
+
+
+/* -----------------------------------------------------------------------------
+sync_mapping()
+DESCRIPTION:  Extends the mapping of the file behind m if the file has grown
+since, by this or another shell, and returns the number of bytes mapped.
+Costs one fstat() when nothing has changed; a grown mapping is extended
+with mremap(), which leaves the pages already mapped where they are.
+-------------------------------------------------------------------------------*/
+static size_t sync_mapping( struct mapping *m )
+{
+  struct stat st;
+  char *map;
+
+  if( m->fd == -1 || fstat( m->fd, &st ) == -1 || (size_t) st.st_size <= m->mapped )
+	return m->mapped;
+  if( m->map != NULL )
+	map = mremap( m->map, m->mapped, st.st_size, MREMAP_MAYMOVE );
+  else
+	map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, m->fd, 0 );
+  if( map == MAP_FAILED )
+	return m->mapped;
+  m->map = map;
+  m->mapped = st.st_size;
+  return m->mapped;
+}
+
+
+/* -----------------------------------------------------------------------------
+rebuild_index()
+DESCRIPTION:  Writes an index entry for every record of the history file,
+for a history file that has no index yet.
+-------------------------------------------------------------------------------*/
+static void rebuild_index( void )
+{
+  size_t size = sync_mapping( &data );
+  uint64_t offsets[512];
+  size_t n = 0, off = 0;
+  const char *nl;
+
+  while( off < size )
+  {
+	offsets[n++] = off;
+	if( n == sizeof(offsets) / sizeof(offsets[0]) )
+	{
+	  if( write( idx.fd, offsets, sizeof(offsets) ) == -1 )
+		return;
+	  n = 0;
+	}
+	nl = memchr( data.map + off, '\n', size - off );
+	if( nl == NULL )
+	  break;
+	off = nl - data.map + 1;
+  }
+  if( n > 0 && write( idx.fd, offsets, n * sizeof(uint64_t) ) == -1 )
+	return;
+}
+
+
+/* -----------------------------------------------------------------------------
+hist_open()
+DESCRIPTION:  Opens the history file at path and its index, creating them
+if needed. Returns 0 on success and -1 if the history cannot be kept, in
+which case the other functions act on an empty history.
+-------------------------------------------------------------------------------*/
+int hist_open( const char *path )
+{
+  char *indexPath = stat_alloc( malloc( strlen( path ) + 5 ) );
+
+  if( indexPath == NULL )
+	return -1;
+  strcpy( indexPath, path );
+  strcat( indexPath, ".idx" );
+
+  data.fd = open( path, O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC, 0600 );
+  idx.fd = open( indexPath, O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC, 0600 );
+  free( indexPath );
+  if( data.fd == -1 || idx.fd == -1 )
+  {
+	if( data.fd != -1 )
+	  close( data.fd );
+	if( idx.fd != -1 )
+	  close( idx.fd );
+	data.fd = idx.fd = -1;
+	return -1;
+  }
+
+  if( sync_mapping( &idx ) == 0 && sync_mapping( &data ) > 0 )
+	rebuild_index();
+  return 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+hist_is_open()
+DESCRIPTION:  Whether hist_open() succeeded.
+-------------------------------------------------------------------------------*/
+int hist_is_open( void )
+{
+  return data.fd != -1;
+}
+
+
+/* -----------------------------------------------------------------------------
+hist_append()
+DESCRIPTION:  Appends line, typed at time when, to the history. The record
+goes out in a single write() to the history file, and its offset in a
+single write() to the index. Newlines in line are stored as spaces.
+Returns 0 on success, -1 on failure.
+-------------------------------------------------------------------------------*/
+int hist_append( const char *line, time_t when )
+{
+  char inlineBuf[RECORD_INLINE_SIZE];
+  char *record = inlineBuf;
+  size_t size = strlen( line ) + 32;
+  uint64_t offset;
+  off_t end;
+  int len, i, status = -1;
+
+  if( data.fd == -1 )
+	return -1;
+  if( size > sizeof(inlineBuf) && (record = stat_alloc( malloc( size ) )) == NULL )
+	return -1;
+
+  len = snprintf( record, size, "%ld\t%s\n", (long) when, line );
+  for( i = 0; i < len - 1; i++ )
+	if( record[i] == '\n' )
+	  record[i] = ' ';
+
+  if( write( data.fd, record, len ) == len &&
+      (end = lseek( data.fd, 0, SEEK_CUR )) != -1 )
+  {
+	offset = end - len;	       /* O_APPEND left us just past our record */
+	if( write( idx.fd, &offset, sizeof(offset) ) == sizeof(offset) )
+	  status = 0;
+  }
+
+  if( record != inlineBuf )
+	free( record );
+  return status;
+}
+
+
+/* -----------------------------------------------------------------------------
+hist_count()
+DESCRIPTION:  The number of entries in the history, including the ones
+appended since the index was last mapped.
+-------------------------------------------------------------------------------*/
+long hist_count( void )
+{
+  return sync_mapping( &idx ) / sizeof(uint64_t);
+}
+
+
+/* -----------------------------------------------------------------------------
+hist_entry()
+DESCRIPTION:  Returns entry n of the history, counting from 0, straight out
+of the mapping: the line is not NUL-terminated, its length is stored in
+len. The time it was typed at is stored in when if that is not NULL.
+Returns NULL if there is no such entry. The pointer stays valid until the
+next call into histstore.
+-------------------------------------------------------------------------------*/
+const char *hist_entry( long n, size_t *len, time_t *when )
+{
+  uint64_t offset;
+  const char *p, *end, *tab, *nl;
+  long t = 0;
+
+  if( n < 0 )
+	return NULL;
+  if( (size_t) (n+1) * sizeof(uint64_t) > idx.mapped && n >= hist_count() )
+	return NULL;
+  memcpy( &offset, idx.map + n * sizeof(uint64_t), sizeof(offset) );
+  if( offset >= data.mapped && offset >= sync_mapping( &data ) )
+	return NULL;
+
+  p = data.map + offset;
+  end = data.map + data.mapped;
+  nl = memchr( p, '\n', end - p );
+  if( nl == NULL )
+	nl = end;
+  tab = memchr( p, '\t', nl - p );
+  if( tab == NULL )		       /* not a record of ours, show it whole */
+	tab = p - 1;
+  else
+	for( ; p < tab && *p >= '0' && *p <= '9'; p++ )
+	  t = t*10 + (*p - '0');
+
+  if( when != NULL )
+	*when = t;
+  *len = nl - (tab + 1);
+  return tab + 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+hist_search()
+DESCRIPTION:  Returns the first entry from entry from on whose line holds
+pattern, or -1 if there is none. The lines are searched in place, in the
+mapping.
+-------------------------------------------------------------------------------*/
+long hist_search( const char *pattern, long from )
+{
+  long n, count = hist_count();
+  size_t len, patternLen = strlen( pattern );
+  const char *line;
+
+  for( n = from < 0 ? 0 : from; n < count; n++ )
+  {
+	line = hist_entry( n, &len, NULL );
+	if( line != NULL && memmem( line, len, pattern, patternLen ) != NULL )
+	  return n;
+  }
+  return -1;
+}
@@ -0,0 +1,11 @@
+/* the persistent history file, see histstore.c */
+
+#define HIST_FILE_NAME ".yosh_history"	/* in $HOME, unless $YOSH_HISTFILE is set */
+
+/* the function prototypes */
+int hist_open(const char *);
+int hist_is_open(void);
+int hist_append(const char *, time_t);
+long hist_count(void);
+const char *hist_entry(long, size_t *, time_t *);
+long hist_search(const char *, long);
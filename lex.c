@@ -0,0 +1,246 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   lex.c  -  The tokenizer of command lines
+ *
+ *   Cuts a line into words and the operators | |& & ; && || and the
+ *   redirections < > >> <& >& &> &>> << <<<, one token per call, in a
+ *   single scan. A redirection may be preceded by the number of the
+ *   descriptor it redirects, as in 2> or 0<&3. Every byte is looked up once in
+ *   a table of character classes, and the state of a word (plain, in
+ *   single quotes, in double quotes, after a backslash) moves on through a
+ *   transition table on that class, so blanks and operators inside quotes
+ *   or after a backslash are part of the word.
+ *
+ *   Inside the { , } group of consumers after |&, lex_next_group() also
+ *   makes { , and } operators, using a second class table; a ${NAME} in a
+ *   word there keeps its braces.
+ *
+ *   A token is only a span of the line: words keep their quotes and
+ *   backslashes, which expand_word() removes when the word is expanded.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include "lex.h"
+
+enum charClasses {
+  C_END,			       /* NUL or newline */
+  C_BLANK,
+  C_PLAIN,
+  C_SQUOTE,
+  C_DQUOTE,
+  C_BSLASH,
+  C_OP,				       /* starts an operator */
+  C_DOLLAR,
+  C_LBRACE,			       /* { and } in a group, plain elsewhere */
+  C_RBRACE,
+  C_CLASSES
+};
+
+enum wordStates {
+  W_PLAIN,
+  W_SQUOTE,			       /* inside '...' */
+  W_DQUOTE,			       /* inside "..." */
+  W_ESCAPE,			       /* after a \ outside quotes */
+  W_DQ_ESCAPE,			       /* after a \ inside "..." */
+  W_DOLLAR,			       /* after a $ outside quotes */
+  W_PARAM,			       /* inside ${...} */
+  W_DONE,			       /* the byte is not part of the word */
+  W_ERROR			       /* the line ended inside quotes */
+};
+
+static const unsigned char transitions[W_DONE][C_CLASSES] = {
+  /*		    END       BLANK     PLAIN     SQUOTE    DQUOTE    BSLASH       OP        DOLLAR    LBRACE    RBRACE */
+  [W_PLAIN]     = { W_DONE,   W_DONE,   W_PLAIN,  W_SQUOTE, W_DQUOTE, W_ESCAPE,    W_DONE,   W_DOLLAR, W_DONE,   W_DONE },
+  [W_SQUOTE]    = { W_ERROR,  W_SQUOTE, W_SQUOTE, W_PLAIN,  W_SQUOTE, W_SQUOTE,    W_SQUOTE, W_SQUOTE, W_SQUOTE, W_SQUOTE },
+  [W_DQUOTE]    = { W_ERROR,  W_DQUOTE, W_DQUOTE, W_DQUOTE, W_PLAIN,  W_DQ_ESCAPE, W_DQUOTE, W_DQUOTE, W_DQUOTE, W_DQUOTE },
+  [W_ESCAPE]    = { W_DONE,   W_PLAIN,  W_PLAIN,  W_PLAIN,  W_PLAIN,  W_PLAIN,     W_PLAIN,  W_PLAIN,  W_PLAIN,  W_PLAIN },
+  [W_DQ_ESCAPE] = { W_ERROR,  W_DQUOTE, W_DQUOTE, W_DQUOTE, W_DQUOTE, W_DQUOTE,    W_DQUOTE, W_DQUOTE, W_DQUOTE, W_DQUOTE },
+  [W_DOLLAR]    = { W_DONE,   W_DONE,   W_PLAIN,  W_SQUOTE, W_DQUOTE, W_ESCAPE,    W_DONE,   W_DOLLAR, W_PARAM,  W_DONE },
+  [W_PARAM]     = { W_ERROR,  W_PARAM,  W_PARAM,  W_PARAM,  W_PARAM,  W_PARAM,     W_PARAM,  W_PARAM,  W_PARAM,  W_PLAIN },
+};
+
+struct operator {
+  const char *text;
+  int len;
+  int type;
+  int group;			       /* only an operator inside a group */
+};
+
+static const struct operator operators[] = {    /* longest first */
+  { "<<<", 3, TOK_TLESS, 0 }, { "&>>", 3, TOK_ANDDGREAT, 0 },
+  { "<<", 2, TOK_DLESS, 0 }, { ">>", 2, TOK_DGREAT, 0 }, { "<&", 2, TOK_LESSAND, 0 },
+  { ">&", 2, TOK_GREATAND, 0 }, { "&>", 2, TOK_ANDGREAT, 0 }, { "&&", 2, TOK_AND, 0 },
+  { "||", 2, TOK_OR, 0 }, { "|&", 2, TOK_FANOUT, 0 },
+  { "<", 1, TOK_LESS, 0 }, { ">", 1, TOK_GREAT, 0 }, { "&", 1, TOK_AMP, 0 },
+  { "|", 1, TOK_PIPE, 0 }, { ";", 1, TOK_SEMI, 0 },
+  { "{", 1, TOK_LBRACE, 1 }, { ",", 1, TOK_COMMA, 1 }, { "}", 1, TOK_RBRACE, 1 }
+};
+
+#define OPERATORS (sizeof(operators) / sizeof(operators[0]))
+#define FD_MAX 9999		       /* a longer number before < or > is a word */
+
+static unsigned char classes[256];
+static unsigned char groupClasses[256];	       /* the same, inside a group */
+static int classesReady = 0;
+
+
+/* -----------------------------------------------------------------------------
+init_classes()
+DESCRIPTION:  Fills in the character class tables, once.
+-------------------------------------------------------------------------------*/
+static void init_classes( void )
+{
+  size_t i;
+
+  memset( classes, C_PLAIN, sizeof(classes) );
+  for( i = 0; i < OPERATORS; i++ )
+	if( !operators[i].group )
+	  classes[(unsigned char) operators[i].text[0]] = C_OP;
+  classes['\0'] = classes['\n'] = C_END;
+  classes[' '] = classes['\t'] = classes['\r'] = classes['\v'] = classes['\f'] = C_BLANK;
+  classes['\''] = C_SQUOTE;
+  classes['"'] = C_DQUOTE;
+  classes['\\'] = C_BSLASH;
+  classes['$'] = C_DOLLAR;
+
+  memcpy( groupClasses, classes, sizeof(classes) );
+  groupClasses[','] = C_OP;
+  groupClasses['{'] = C_LBRACE;
+  groupClasses['}'] = C_RBRACE;
+  classesReady = 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+lex_operator()
+DESCRIPTION:  Reads the longest operator at s[i] into tok and returns its
+type, or TOK_END if there is none.
+-------------------------------------------------------------------------------*/
+static int lex_operator( const char *s, int i, lexToken *tok )
+{
+  size_t k;
+
+  for( k = 0; k < OPERATORS; k++ )
+	if( s[i] == operators[k].text[0] &&
+	    strncmp( s + i, operators[k].text, operators[k].len ) == 0 )
+	{
+	  tok->type = operators[k].type;
+	  tok->len = operators[k].len;
+	  return tok->type;
+	}
+  return TOK_END;
+}
+
+
+/* -----------------------------------------------------------------------------
+lex_scan()
+DESCRIPTION:  Does the work of lex_next() and lex_next_group() with the given
+class table.
+-------------------------------------------------------------------------------*/
+static int lex_scan( const char *line, int *pos, lexToken *tok,
+		     const unsigned char *table )
+{
+  const unsigned char *s = (const unsigned char *) line;
+  int i = *pos, state, fd, k;
+
+  while( table[s[i]] == C_BLANK )
+	i++;
+  tok->start = i;
+  tok->fd = -1;
+
+  switch( table[s[i]] )
+  {
+	case C_END:
+	  tok->type = TOK_END;
+	  tok->len = 0;
+	  *pos = i;
+	  return TOK_END;
+	case C_OP:
+	case C_LBRACE:
+	case C_RBRACE:
+	  lex_operator( line, i, tok );
+	  *pos = i + tok->len;
+	  return tok->type;
+  }
+
+  /* a descriptor number right before a < or > belongs to the redirection */
+  for( fd = 0, k = i; s[k] >= '0' && s[k] <= '9' && fd <= FD_MAX; k++ )
+	fd = fd * 10 + s[k] - '0';
+  if( k > i && fd <= FD_MAX && (s[k] == '<' || s[k] == '>') )
+  {
+	lex_operator( line, k, tok );
+	tok->start = i;
+	tok->fd = fd;
+	*pos = k + tok->len;
+	tok->len = *pos - i;
+	return tok->type;
+  }
+
+  for( state = W_PLAIN; ; i++ )
+  {
+	if( state == W_PLAIN )	       /* the common case, skipped without the transitions */
+	  while( table[s[i]] == C_PLAIN )
+		i++;
+	state = transitions[state][table[s[i]]];
+	if( state >= W_DONE )
+	  break;
+  }
+  if( state == W_ERROR )
+  {
+	tok->type = TOK_ERROR;
+	tok->len = i - tok->start;
+	*pos = tok->start;
+	return TOK_ERROR;
+  }
+  tok->type = TOK_WORD;
+  tok->len = i - tok->start;
+  *pos = i;
+  return TOK_WORD;
+}
+
+
+/* -----------------------------------------------------------------------------
+lex_next()
+DESCRIPTION:  Reads the token of line that starts at or after *pos into tok,
+leaves *pos just past it and returns its type. At the end of the line, and
+after a TOK_ERROR, it keeps returning that same token.
+-------------------------------------------------------------------------------*/
+int lex_next( const char *line, int *pos, lexToken *tok )
+{
+  if( !classesReady )
+	init_classes();
+  return lex_scan( line, pos, tok, classes );
+}
+
+
+/* -----------------------------------------------------------------------------
+lex_next_group()
+DESCRIPTION:  lex_next() for the inside of a { , } group of consumers, where
+{ , and } are operators too.
+-------------------------------------------------------------------------------*/
+int lex_next_group( const char *line, int *pos, lexToken *tok )
+{
+  if( !classesReady )
+	init_classes();
+  return lex_scan( line, pos, tok, groupClasses );
+}
+
+
+/* -----------------------------------------------------------------------------
+lex_name()
+DESCRIPTION:  How a token type is written, for error messages.
+-------------------------------------------------------------------------------*/
+const char *lex_name( int type )
+{
+  static const char *names[] = {
+	"newline", "word", "|", "<", ">", ">>", "<&", ">&", "&>", "&>>", "<<", "<<<",
+	"&", ";", "&&", "||", "|&", "{", ",", "}", "quote"
+  };
+
+  if( type < 0 || type > TOK_ERROR )
+	return "?";
+  return names[type];
+}
@@ -0,0 +1,37 @@
+/* the tokenizer of command lines, see lex.c */
+
+enum tokenTypes {
+  TOK_END = 0,			       /* end of the line, or a newline */
+  TOK_WORD,			       /* quotes and escapes still in it */
+  TOK_PIPE,			       /* | */
+  TOK_LESS,			       /* < */
+  TOK_GREAT,			       /* > */
+  TOK_DGREAT,			       /* >> */
+  TOK_LESSAND,			       /* <& */
+  TOK_GREATAND,			       /* >& */
+  TOK_ANDGREAT,			       /* &> */
+  TOK_ANDDGREAT,		       /* &>> */
+  TOK_DLESS,			       /* << */
+  TOK_TLESS,			       /* <<< */
+  TOK_AMP,			       /* & */
+  TOK_SEMI,			       /* ; */
+  TOK_AND,			       /* && */
+  TOK_OR,			       /* || */
+  TOK_FANOUT,			       /* |& */
+  TOK_LBRACE,			       /* {, only inside a group */
+  TOK_COMMA,			       /* , */
+  TOK_RBRACE,			       /* } */
+  TOK_ERROR			       /* a quote that is never closed */
+};
+
+typedef struct {		       /* a span of the line, nothing is copied */
+  int type;
+  int start;			       /* offset of the first byte in the line */
+  int len;
+  int fd;			       /* the N of N> or N<, -1 when not given */
+} lexToken;
+
+/* the function prototypes */
+int lex_next(const char *, int *, lexToken *);
+int lex_next_group(const char *, int *, lexToken *);
+const char *lex_name(int);
@@ -16,9 +16,169 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
 #include "parse.h"
+#include "lex.h"
 
-#define MAXLINE 81
+#define LINE_INLINE_SIZE 256	       /* longer lines are copied to the heap */
+#define ARENA_CHUNK_SIZE 8192
+#define ARENA_ALIGN 16
+
+static builtinResolver resolve_builtin = NULL;
+static allocCounter count_alloc = NULL;
+
+
+/* -----------------------------------------------------------------------------
+arena_init()
+DESCRIPTION:  Initializes an empty arena. Nothing is allocated until the
+first arena_alloc().
+-------------------------------------------------------------------------------*/
+void arena_init( parseArena *a )
+{
+  a->chunks=NULL;
+  a->next=NULL;
+  a->limit=NULL;
+  a->total=0;
+}
+
+
+/* -----------------------------------------------------------------------------
+arena_free()
+DESCRIPTION:  Releases every chunk of the arena.
+-------------------------------------------------------------------------------*/
+void arena_free( parseArena *a )
+{
+  struct arenaChunk *c, *next;
+
+  for( c=a->chunks; c!=NULL; c=next )
+  {
+	next=c->next;
+	free(c);
+  }
+  arena_init( a );
+}
+
+
+/* -----------------------------------------------------------------------------
+arena_reset()
+
+DESCRIPTION:  Forgets everything allocated from the arena while keeping its
+memory, so the next line is parsed without calling malloc. If the last line
+needed more than one chunk they are replaced by a single chunk big enough for
+all of it, which makes the arena settle at the size of the largest line seen.
+-------------------------------------------------------------------------------*/
+void arena_reset( parseArena *a )
+{
+  size_t total=a->total;
+
+  if( a->chunks != NULL && a->chunks->next != NULL )
+  {
+	arena_free( a );
+	arena_alloc( a, total );
+  }
+  if( a->chunks != NULL )
+	a->next=(char *)(a->chunks+1);
+}
+
+
+/* -----------------------------------------------------------------------------
+arena_alloc()
+DESCRIPTION:  Returns size bytes from the arena, aligned for any type, or
+NULL if memory ran out.
+-------------------------------------------------------------------------------*/
+void *arena_alloc( parseArena *a, size_t size )
+{
+  struct arenaChunk *c;
+  void *mem;
+
+  size=(size+ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+  if( a->next == NULL || (size_t)(a->limit-a->next) < size )
+  {
+	size_t chunkSize=ARENA_CHUNK_SIZE;
+
+	while( chunkSize < size )
+		chunkSize*=2;
+	c=malloc( sizeof(struct arenaChunk)+chunkSize );
+	if( c == NULL )
+		return NULL;
+	if( count_alloc != NULL )
+		count_alloc();
+	c->size=chunkSize;
+	c->next=a->chunks;
+	a->chunks=c;
+	a->total+=chunkSize;
+	a->next=(char *)(c+1);
+	a->limit=a->next+chunkSize;
+  }
+  mem=a->next;
+  a->next+=size;
+  return mem;
+}
+
+
+/* -----------------------------------------------------------------------------
+arena_strdup()
+DESCRIPTION:  strdup() into the arena
+-------------------------------------------------------------------------------*/
+char *arena_strdup( parseArena *a, const char *str )
+{
+  size_t len=strlen(str)+1;
+  char *copy=arena_alloc( a, len );
+
+  if( copy != NULL )
+	memcpy( copy, str, len );
+  return copy;
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_alloc()
+DESCRIPTION:  Allocates from the arena when there is one, else with malloc.
+-------------------------------------------------------------------------------*/
+static void *parse_alloc( parseArena *arena, size_t size )
+{
+  if( arena != NULL )
+	return arena_alloc( arena, size );
+  return malloc( size );
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_word()
+DESCRIPTION:  Returns word, which has been terminated in place in the copy of
+the line, as it is to be stored in the result: as is with an arena, otherwise
+in its own malloc'd string.
+-------------------------------------------------------------------------------*/
+static char *parse_word( char *word, parseArena *arena )
+{
+  char *copy;
+
+  if( arena != NULL )
+	return word;
+  copy=malloc( (strlen(word)+1)*sizeof(char) );
+  if( copy != NULL )
+	strcpy( copy, word );
+  return copy;
+}
+
+
+/* -----------------------------------------------------------------------------
+init_command()
+DESCRIPTION:  Initializes a command to an empty argv in its inline storage
+-------------------------------------------------------------------------------*/
+static void init_command( struct commandType *comm )
+{
+  comm->command=NULL;
+  comm->builtin=0;
+  comm->branch=0;
+  comm->redirs=NULL;
+  comm->lastRedir=NULL;
+  comm->VarList=comm->InlineVars;
+  comm->VarList[0]=NULL;
+  comm->VarNum=0;
+  comm->VarCap=MAX_VAR_NUM;
+}
 
 
 /* -----------------------------------------------------------------------------
@@ -27,225 +187,605 @@ DESCRIPTION:  Initializes info structure
 -------------------------------------------------------------------------------*/
 void init_info( parseInfo *p )
 {
-  int i;
-  p->boolInfile=0;
-  p->boolOutfile=0;
   p->boolBackground=0;
   p->pipeNum=0;
+  p->fanOut=0;
+  p->CommArray=p->InlineComm;
+  p->commCap=PIPE_MAX_NUM;
+  p->arena=NULL;
+
+  init_command( &p->CommArray[0] );
+}
+
 
-  for( i=0; i<PIPE_MAX_NUM; i++ )
+/* -----------------------------------------------------------------------------
+add_var()
+DESCRIPTION:  Appends a word to the argv of comm, doubling VarList when it
+is full. Returns 0 if memory ran out.
+-------------------------------------------------------------------------------*/
+static int add_var( struct commandType *comm, char *word, parseArena *arena )
+{
+  char **vars;
+
+  if( comm->VarNum+1 == comm->VarCap )	/* keep room for the NULL */
   {
-    	p->CommArray[i].command=NULL;
-    	p->CommArray[i].VarList[0]=NULL;
-    	p->CommArray[i].VarNum=0;
+	vars=parse_alloc( arena, 2*comm->VarCap*sizeof(char *) );
+	if( vars == NULL )
+		return 0;
+	memcpy( vars, comm->VarList, comm->VarNum*sizeof(char *) );
+	if( arena == NULL && comm->VarList != comm->InlineVars )
+		free( comm->VarList );
+	comm->VarList=vars;
+	comm->VarCap*=2;
   }
+  comm->VarList[comm->VarNum++]=word;
+  comm->VarList[comm->VarNum]=NULL;
+  return 1;
 }
 
 
 /* -----------------------------------------------------------------------------
-parse_command()
-DESCRIPTION:  
+syntax_error()
+DESCRIPTION:  Reports the token the parser did not expect.
 -------------------------------------------------------------------------------*/
-int parse_command( char * command, struct commandType *comm )
+static void syntax_error( const char *cmdline, lexToken *tok )
 {
-  int i=0;
-  int pos=0;
-  char word[MAXLINE];
+  if( tok->type == TOK_ERROR )
+	fprintf( stderr, "Unterminated quote: %.*s\n", tok->len, cmdline+tok->start );
+  else
+	fprintf( stderr, "Syntax error near %s.\n", lex_name( tok->type ) );
+}
 
-  comm->VarNum=0;
-  comm->command=NULL;
-  comm->VarList[0]=NULL;
 
-  while( isspace(command[i]) )  // skip over spaces 
-    	i++; 
+/* -----------------------------------------------------------------------------
+add_redirect()
+DESCRIPTION:  Appends a redirection to the list of comm. Returns 0 if memory
+ran out, in which case word is not kept either.
+-------------------------------------------------------------------------------*/
+static int add_redirect( struct commandType *comm, int type, int fd, int target,
+		char *word, parseArena *arena )
+{
+  struct redirect *r=parse_alloc( arena, sizeof(struct redirect) );
 
+  if( r == NULL )
+  {
+	if( arena == NULL )
+		free( word );
+	return 0;
+  }
+  r->type=type;
+  r->fd=fd;
+  r->target=target;
+  r->word=word;
+  r->body=NULL;
+  r->quoted=0;
+  r->next=NULL;
+  if( comm->lastRedir != NULL )
+	comm->lastRedir->next=r;
+  else
+	comm->redirs=r;
+  comm->lastRedir=r;
+  return 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_redirect()
 
-  if( command[i] == '\0' )   	// end of word
-    	return 1;
+DESCRIPTION:  Adds the redirection whose operator is tok, and whose word is
+the next token, to comm. The word of <& and >& is the number of the
+descriptor to copy, or - to close it; >& followed by anything else is &>,
+which sends both standard output and standard error to a file, and is kept
+as a > followed by 2>&1. Returns 0 after a syntax error or if memory ran out.
+-------------------------------------------------------------------------------*/
+static int parse_redirect( char *cmdline, char *line, int *pos, parseArena *arena,
+		struct commandType *comm, lexToken *tok, int group )
+{
+  int op=tok->type;
+  int fd=tok->fd;
+  int type, target=-1;
+  char *word;
 
-  while( command[i] != '\0' )	// while not end of word
+  if( (group ? lex_next_group( cmdline, pos, tok ) : lex_next( cmdline, pos, tok )) != TOK_WORD )
   {
-  	while( command[i] != '\0'  && !isspace(command[i]) )
-	{
-      		word[pos++] = command[i++];
-    	}
-    	word[pos]='\0';
+	syntax_error( cmdline, tok );
+	return 0;
+  }
+  line[tok->start+tok->len]='\0';
+  word=&line[tok->start];
 
-    	if( comm->VarNum == MAX_VAR_NUM )
-    	{
-      		fprintf( stderr, "Too many arguments to command.\n" );
-      		return 0;
-    	}
+  switch( op )
+  {
+  case TOK_LESS:	type=REDIR_IN; break;
+  case TOK_DGREAT:	type=REDIR_APPEND; break;
+  case TOK_ANDDGREAT:	type=REDIR_APPEND; break;
+  case TOK_DLESS:	type=REDIR_HEREDOC; break;
+  case TOK_TLESS:	type=REDIR_HERESTRING; break;
+  default:		type=REDIR_OUT; break;
+  }
+
+  if( op == TOK_LESSAND || op == TOK_GREATAND )
+  {
+	if( strcmp( word, "-" ) == 0 )
+		type=REDIR_CLOSE;
+	else if( word[strspn( word, "0123456789" )] == '\0' && strlen( word ) <= 4 )
+	{
+		type=REDIR_DUP;
+		target=atoi( word );
+	}
+	else if( op == TOK_GREATAND && fd == -1 )
+		op=TOK_ANDGREAT;
+	else
+	{
+		fprintf( stderr, "%s: Bad file descriptor.\n", word );
+		return 0;
+	}
+	word=NULL;
+  }
+  if( fd == -1 )
+	fd=(op == TOK_LESS || op == TOK_LESSAND || op == TOK_DLESS || op == TOK_TLESS) ? 0 : 1;
 
-    	comm->VarList[comm->VarNum] = malloc((strlen(word)+1)*sizeof(char));
-    	strcpy( comm->VarList[comm->VarNum], word );
-    	comm->VarNum++;
-    	word[0]='\0';
-    	pos=0;
-    	while( isspace(command[i]) )
-      		i++; 
+  if( type != REDIR_DUP && type != REDIR_CLOSE &&
+      (word=parse_word( &line[tok->start], arena )) == NULL )
+  {
+	fprintf( stderr, "Out of memory.\n" );
+	return 0;
+  }
+  if( !add_redirect( comm, type, fd, target, word, arena ) ||
+      ((op == TOK_ANDGREAT || op == TOK_ANDDGREAT) &&
+       !add_redirect( comm, REDIR_DUP, 2, 1, NULL, arena )) )
+  {
+	fprintf( stderr, "Out of memory.\n" );
+	return 0;
   }
-  comm->command=malloc((strlen(comm->VarList[0])+1)*sizeof(char));
-  strcpy(comm->command, comm->VarList[0]);
-  comm->VarList[comm->VarNum]=NULL;
   return 1;
 }
 
 
+/* -----------------------------------------------------------------------------
+add_command()
+DESCRIPTION:  Starts the next command of the pipeline, doubling CommArray
+when it is full. Commands whose argv is still inline are re-pointed at their
+own InlineVars after the move. Returns 0 if memory ran out.
+-------------------------------------------------------------------------------*/
+static int add_command( parseInfo *p )
+{
+  struct commandType *comms;
+  int i;
+
+  if( p->pipeNum+1 == p->commCap )
+  {
+	comms=parse_alloc( p->arena, 2*p->commCap*sizeof(struct commandType) );
+	if( comms == NULL )
+		return 0;
+	memcpy( comms, p->CommArray, (p->pipeNum+1)*sizeof(struct commandType) );
+	for( i=0; i<=p->pipeNum; i++ )
+	{
+		if( p->CommArray[i].VarList == p->CommArray[i].InlineVars )
+			comms[i].VarList=comms[i].InlineVars;
+	}
+	if( p->arena == NULL && p->CommArray != p->InlineComm )
+		free( p->CommArray );
+	p->CommArray=comms;
+	p->commCap*=2;
+  }
+  p->pipeNum++;
+  init_command( &p->CommArray[p->pipeNum] );
+  p->CommArray[p->pipeNum].branch=p->CommArray[p->pipeNum-1].branch;
+  return 1;
+}
+
 
 /* -----------------------------------------------------------------------------
-parse_info()
+end_command()
 
-DESCRIPTION:   Takes in a string cmdline, and returns a pointer to a struct
-parseInfo. The members of parseInfo can be seen in parse.h.  Commands
-are always stored in the array CommArray. 
+DESCRIPTION:  Finishes the words of one command of the pipeline: its name is
+its first word, and the builtin resolver is asked about it. A command with no
+words is left with a NULL name. Returns 0 if memory ran out.
+-------------------------------------------------------------------------------*/
+static int end_command( struct commandType *comm, parseArena *arena )
+{
+  if( comm->VarNum == 0 )
+	return 1;
+  comm->command=parse_word( comm->VarList[0], arena );
+  if( comm->command == NULL )
+  {
+	fprintf( stderr, "Out of memory.\n" );
+	return 0;
+  }
+  if( resolve_builtin != NULL )
+	comm->builtin=resolve_builtin( comm->command );
+  return 1;
+}
 
-This can accommodate multiple pipes. In commandType, command is the 
-executable name and VarList is the argv to pass to the program.  cmdline 
-can end either with '\n' or '\0'.
 
-TODO: Need to be modulariszed a bit more (not required)
+/* -----------------------------------------------------------------------------
+copy_line()
+DESCRIPTION:  Makes the copy of cmdline that the parser cuts up: in the arena
+if there is one, else in stackLine when it fits, else with malloc. Returns
+NULL if memory ran out.
 -------------------------------------------------------------------------------*/
-parseInfo *parse( char *cmdline )
+static char *copy_line( char *cmdline, parseArena *arena, char *stackLine )
+{
+  size_t len=strlen( cmdline )+1;
+  char *line;
+
+  if( arena != NULL )
+	line=arena_alloc( arena, len );
+  else if( len <= LINE_INLINE_SIZE )
+	line=stackLine;
+  else
+	line=malloc( len );
+  if( line != NULL )
+	memcpy( line, cmdline, len );
+  return line;
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_pipeline()
+
+DESCRIPTION:   Parses the pipeline that starts at cmdline[*pos], reading it
+token by token with lex_next(), while line, the copy of cmdline, is cut up
+into its words: each word is terminated in place in the copy, where its token
+ends. With an arena the result points into the copy. Without one the words
+are copied out. The token that ended the pipeline is left in tok, and *pos
+after it: the end of the line, ;, &&, || or &, which also sets
+boolBackground. Returns NULL after a syntax error or if memory ran out. The
+only limit is the kernel's: the argv of a command has to fit in ARG_MAX.
+
+The last command may be followed by |& and a group of consumers, as in
+cmd |& {a, b | c}: every consumer is a pipeline of its own that reads a copy
+of what cmd writes. The commands of the group follow cmd in CommArray, each
+with the number of its consumer in branch, counted from 1, and fanOut is the
+number of consumers. A group has to end the pipeline and cannot be nested.
+-------------------------------------------------------------------------------*/
+static parseInfo *parse_pipeline( char *cmdline, char *line, int *pos,
+		parseArena *arena, lexToken *tok )
 {
+  static long argMax=0;
+  long argBytes=0;
   parseInfo *Result;
-  int i=0;
-  int pos;
-  int end=0;
-  char command[MAXLINE];
-  int com_pos;
-  int iscommproper = 0;
-
-  if( cmdline[i] == '\n' && cmdline[i] == '\0' )
-    return NULL;
-
-  Result = malloc(sizeof(parseInfo));
-  if( Result == NULL)
-	{
-    	return NULL;
-  	}
+  char *word;
+  int ok=1, done=0;
+  int group=0;			       /* 1 inside { }, 2 after it */
 
+  if( argMax == 0 )
+  {
+	argMax=sysconf( _SC_ARG_MAX );
+	if( argMax <= 0 )
+		argMax=LONG_MAX;
+  }
+
+  Result=parse_alloc( arena, sizeof(parseInfo) );
+  if( Result == NULL )
+	return NULL;
   init_info( Result );
-  com_pos=0;
-  while (cmdline[i] != '\n' && cmdline[i] != '\0') 
+  Result->arena=arena;
+  while( ok && !done )
   {
-    	if( cmdline[i] == '&' )
-	{
-      		Result->boolBackground=1;
+	struct commandType *comm=&Result->CommArray[Result->pipeNum];
+	int type=group == 1 ? lex_next_group( cmdline, pos, tok ) : lex_next( cmdline, pos, tok );
+	int ends=type == TOK_END || type == TOK_SEMI || type == TOK_AND ||
+		 type == TOK_OR || type == TOK_AMP;
 
-      		if( cmdline[i+1] != '\n' && cmdline[i+1] != '\0') 
+	if( (group == 1 && ends) || (group == 2 && !ends) )
+	{
+		syntax_error( cmdline, tok );      /* an open group, or more after it */
+		ok=0;
+		break;
+	}
+	switch( type )
+	{
+	case TOK_WORD:
+		line[tok->start+tok->len]='\0';
+		argBytes+=tok->len+1+sizeof(char *);
+		if( argBytes > argMax )
 		{
-			fprintf(stderr, "Ignore anything beyond &.\n");
-      		}
+			fprintf( stderr, "Argument list too long.\n" );
+			ok=0;
+			break;
+		}
+		word=parse_word( &line[tok->start], arena );
+		if( word == NULL || !add_var( comm, word, arena ) )
+		{
+			fprintf( stderr, "Out of memory.\n" );
+			if( arena == NULL )
+				free( word );
+			ok=0;
+		}
+		break;
+
+	case TOK_PIPE:
+		if( comm->VarNum == 0 && comm->redirs == NULL )
+		{
+			syntax_error( cmdline, tok );
+			ok=0;
+		}
+		else if( !end_command( comm, arena ) || !add_command( Result ) )
+			ok=0;
+		argBytes=0;
+		break;
+
+	case TOK_FANOUT:
+	case TOK_COMMA:
+		if( (comm->VarNum == 0 && comm->redirs == NULL) || (type == TOK_FANOUT && group) ||
+		    (type == TOK_FANOUT && lex_next_group( cmdline, pos, tok ) != TOK_LBRACE) )
+		{
+			syntax_error( cmdline, tok );
+			ok=0;
+		}
+		else if( !end_command( comm, arena ) || !add_command( Result ) )
+			ok=0;
+		else
+		{
+			Result->CommArray[Result->pipeNum].branch=++Result->fanOut;
+			group=1;
+		}
+		argBytes=0;
+		break;
+
+	case TOK_RBRACE:
+		if( comm->VarNum == 0 && comm->redirs == NULL )
+		{
+			syntax_error( cmdline, tok );
+			ok=0;
+		}
+		group=2;
+		break;
+
+	case TOK_LESS:
+	case TOK_GREAT:
+	case TOK_DGREAT:
+	case TOK_LESSAND:
+	case TOK_GREATAND:
+	case TOK_ANDGREAT:
+	case TOK_ANDDGREAT:
+	case TOK_DLESS:
+	case TOK_TLESS:
+		ok=parse_redirect( cmdline, line, pos, arena, comm, tok, group == 1 );
+		break;
+
+	case TOK_AMP:
+		Result->boolBackground=1;
+		done=1;
+		break;
+
+	case TOK_END:
+	case TOK_SEMI:
+	case TOK_AND:
+	case TOK_OR:
+		done=1;
+		break;
+
+	default:		       /* an unterminated quote, a stray { */
+		syntax_error( cmdline, tok );
+		ok=0;
+		break;
+	}
+  }
 
-      		break;
-    	}
+  if( ok && Result->pipeNum > 0 && Result->CommArray[Result->pipeNum].VarNum == 0 &&
+      Result->CommArray[Result->pipeNum].redirs == NULL )
+  {
+	syntax_error( cmdline, tok );
+	ok=0;
+  }
+  if( ok )
+	ok=end_command( &Result->CommArray[Result->pipeNum], arena );
+  if( !ok )
+  {
+	free_info( Result );
+	return NULL;
+  }
+  return Result;
+}
 
-    	else if (cmdline[i] == '<') 
-	{
-      		Result->boolInfile++;
-      		while( isspace( cmdline[++i] ) );
-      		pos=0;
-      		while (cmdline[i] != '\0' && !isspace(cmdline[i])) 
-		{
-			if( pos==FILE_MAX_SIZE )
-			{
-	  			fprintf(stderr, "Error. The input redirection "
-					"file name exceeds the size limit 40\n");
-	  			free_info( Result );
-	  			return NULL;
-			}
-			Result->inFile[pos++] = cmdline[i++];
-      		}
 
-      		Result->inFile[pos]='\0';
-      		end = 1;
+/* -----------------------------------------------------------------------------
+is_empty()
+DESCRIPTION:  Whether a pipeline has neither words nor redirections, as
+between two ; or on a blank line.
+-------------------------------------------------------------------------------*/
+static int is_empty( parseInfo *p )
+{
+  return p->pipeNum == 0 && p->CommArray[0].VarNum == 0 &&
+	 p->CommArray[0].redirs == NULL;
+}
 
-      		while( isspace(cmdline[i])) 
-		{
-		if( cmdline[i] == '\n' )
-	  		break;
-		i++;
-      		}
-    	}
 
-    	else if (cmdline[i] == '>') 
-	{
-      		Result->boolOutfile++;
-      		while (isspace(cmdline[++i]));
-      		pos=0;
-      		while( cmdline[i] != '\0' && !isspace(cmdline[i])) 
-		{
-			if( pos==FILE_MAX_SIZE) 
-			{
-	  			fprintf( stderr, "Error.The output redirection file "
-					"name exceeds the size limit 40\n");
-	  			free_info(Result);
-
-	  			return NULL;
-			}
-			Result->outFile[pos++] = cmdline[i++];
-      		}
+/* -----------------------------------------------------------------------------
+parse_line()
 
-      		Result->outFile[pos]='\0';
-      		end = 1;
-      		while( isspace(cmdline[i])) 
-		{
-			if( cmdline[i] == '\n' )
-	  			break;
-			i++;
-      		} 
-    	}
+DESCRIPTION:   Does the work of parse() and parse_arena(): parses a line
+holding one pipeline. Anything after a & is ignored, and ; && and || are
+syntax errors. Without an arena the copy of the line lives on the stack
+unless the line is long.
+-------------------------------------------------------------------------------*/
+static parseInfo *parse_line( char *cmdline, parseArena *arena )
+{
+  parseInfo *Result;
+  char stackLine[LINE_INLINE_SIZE];
+  char *line;			       /* copy of cmdline that gets cut up */
+  lexToken tok;
+  int pos=0;
 
-    	else if (cmdline[i] == '|') 
-	{
-      		command[com_pos]='\0';
-      		iscommproper = parse_command( command, 
-					&Result->CommArray[Result->pipeNum]);
-      		if( ! iscommproper ) 
-		{
-			free_info( Result );
-			return NULL;
-      		}
+  line=copy_line( cmdline, arena, stackLine );
+  if( line == NULL )
+	return NULL;
 
-      		com_pos = 0;
-     		end = 0;
-      		Result->pipeNum++;
-      		i++;
-    	}
+  Result=parse_pipeline( cmdline, line, &pos, arena, &tok );
+  if( Result != NULL && tok.type == TOK_AMP )
+  {
+	if( lex_next( cmdline, &pos, &tok ) != TOK_END )
+		fprintf( stderr, "Ignore anything beyond &.\n" );
+  }
+  else if( Result != NULL && tok.type != TOK_END )
+  {
+	syntax_error( cmdline, &tok );
+	free_info( Result );
+	Result=NULL;
+  }
 
-    	else 
-	{
-      		if( end == 1 )
-		{
-	 		fprintf( stderr, "Error.Wrong format of input\n" );
-	 		free_info( Result );
-	 		return NULL;
-      		}
+  if( arena == NULL && line != stackLine )
+	free( line );
+  return Result;
+}
 
-      		if( com_pos == MAXLINE-1 )
-		{
-			fprintf( stderr, "Error. The command length exceeds "
-				"the limit 80\n" );
-			free_info( Result );
-			return NULL;
-      		}
 
-      	command[com_pos++] = cmdline[i++];
-    	}
+/* -----------------------------------------------------------------------------
+add_entry()
+DESCRIPTION:  Appends a pipeline to list, doubling its entries when they are
+full. Returns 0 if memory ran out.
+-------------------------------------------------------------------------------*/
+static int add_entry( commandList *list, parseInfo *pipeline, int op )
+{
+  struct listEntry *entries;
+
+  if( list->count == list->cap )
+  {
+	entries=parse_alloc( list->arena, 2*list->cap*sizeof(struct listEntry) );
+	if( entries == NULL )
+		return 0;
+	memcpy( entries, list->entries, list->count*sizeof(struct listEntry) );
+	if( list->arena == NULL && list->entries != list->InlineEntries )
+		free( list->entries );
+	list->entries=entries;
+	list->cap*=2;
   }
+  list->entries[list->count].pipeline=pipeline;
+  list->entries[list->count].op=op;
+  list->count++;
+  return 1;
+}
 
-  command[com_pos]='\0';
 
-  iscommproper = parse_command( command, &Result->CommArray[Result->pipeNum] );
-  if ( ! iscommproper ) 
+/* -----------------------------------------------------------------------------
+parse_list()
+
+DESCRIPTION:   Parses a whole line into the list of its pipelines, joined by
+; & && and ||, in the order they are written. A pipeline followed by & runs
+in the background; each entry tells by op whether the next one always runs
+(LIST_SEQ) or only after success (LIST_AND) or failure (LIST_OR). A blank
+line gives an empty list, and a trailing ; or & is allowed. With an arena
+the whole result is allocated from it, otherwise it is released with
+free_list(). Returns NULL after a syntax error or if memory ran out.
+-------------------------------------------------------------------------------*/
+commandList *parse_list( char *cmdline, parseArena *arena )
+{
+  commandList *list;
+  parseInfo *pipeline;
+  char stackLine[LINE_INLINE_SIZE];
+  char *line;
+  lexToken tok;
+  int pos=0, op;
+
+  list=parse_alloc( arena, sizeof(commandList) );
+  line=copy_line( cmdline, arena, stackLine );
+  if( list == NULL || line == NULL )
   {
-    	free_info(Result);
-    	return NULL;
+	if( arena == NULL )
+	{
+		free( list );
+		if( line != stackLine )
+			free( line );
+	}
+	return NULL;
   }
+  list->entries=list->InlineEntries;
+  list->count=0;
+  list->cap=LIST_INLINE_NUM;
+  list->arena=arena;
 
-  //Result->pipeNum++;
-  return Result;
+  do
+  {
+	pipeline=parse_pipeline( cmdline, line, &pos, arena, &tok );
+	if( pipeline == NULL )
+	{
+		free_list( list );
+		list=NULL;
+		break;
+	}
+	if( is_empty( pipeline ) )
+	{
+		free_info( pipeline );
+		if( tok.type != TOK_END ||
+		    (list->count > 0 && list->entries[list->count-1].op != LIST_SEQ) )
+		{
+			syntax_error( cmdline, &tok );
+			free_list( list );
+			list=NULL;
+		}
+		break;
+	}
+	op=tok.type == TOK_AND ? LIST_AND : tok.type == TOK_OR ? LIST_OR : LIST_SEQ;
+	if( !add_entry( list, pipeline, op ) )
+	{
+		fprintf( stderr, "Out of memory.\n" );
+		free_info( pipeline );
+		free_list( list );
+		list=NULL;
+		break;
+	}
+  } while( tok.type != TOK_END );
+
+  if( arena == NULL && line != stackLine )
+	free( line );
+  return list;
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_set_builtin_resolver()
+DESCRIPTION:  Installs the function that parse() asks, once per command,
+whether the command is a builtin. Its answer is kept in commandType.builtin.
+-------------------------------------------------------------------------------*/
+void parse_set_builtin_resolver( builtinResolver resolver )
+{
+  resolve_builtin=resolver;
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_set_alloc_counter()
+DESCRIPTION:  Installs the function called whenever an arena grows by a chunk,
+so that the shell can count those allocations with its own.
+-------------------------------------------------------------------------------*/
+void parse_set_alloc_counter( allocCounter counter )
+{
+  count_alloc=counter;
+}
+
+
+/* -----------------------------------------------------------------------------
+parse()
+
+DESCRIPTION:   Takes in a string cmdline, and returns a pointer to a struct
+parseInfo. The members of parseInfo can be seen in parse.h.  Commands
+are always stored in the array CommArray. 
+
+This can accommodate multiple pipes. In commandType, command is the 
+executable name and VarList is the argv to pass to the program.  cmdline 
+can end either with '\n' or '\0'. The result is malloc'd and must be
+released with free_info().
+-------------------------------------------------------------------------------*/
+parseInfo *parse( char *cmdline )
+{
+  return parse_line( cmdline, NULL );
+}
+
+
+/* -----------------------------------------------------------------------------
+parse_arena()
+
+DESCRIPTION:   Same as parse(), but the whole result, its words and a copy of
+cmdline they point into are allocated from arena. Nothing has to be freed;
+the result stays valid until the arena is reset, which once the arena has
+grown to fit the longest line makes parsing free of malloc calls.
+-------------------------------------------------------------------------------*/
+parseInfo *parse_arena( char *cmdline, parseArena *arena )
+{
+  return parse_line( cmdline, arena );
 }
 
 
@@ -265,6 +805,8 @@ void print_info (parseInfo *info)
   }
   printf("Parse struct:\n\n");
   printf("# of pipes:%d\n", info->pipeNum);
+  if (info->fanOut > 0)
+	printf("# of consumers after |&:%d\n", info->fanOut);
 
   for( i=0; i<=info->pipeNum;i++ ) 
   {
@@ -277,6 +819,8 @@ void print_info (parseInfo *info)
 	{
       		printf("Command %d is %s.\t", i+1, comm->command);
       		printf("Number of Arguments: %d\n", comm->VarNum);
+      		if (comm->branch > 0)
+			printf("Consumer %d\n", comm->branch);
       		for (j=0; j<comm->VarNum; j++) 
 		{
 			printf("Arg %d: %s ", j, comm->VarList[j]);
@@ -286,22 +830,19 @@ void print_info (parseInfo *info)
   }
   printf("\n");
 
-  if (info->boolInfile)
-  {
-    	printf("infile: %s\n", info->inFile);
-  }
-  else 
+  for( i=0; i<=info->pipeNum;i++ ) 
   {
-    	printf("no input redirection.\n");
-  }
+	static const char *types[]={ "<", ">", ">>", ">&", ">&-", "<<<", "<<" };
+	struct redirect *r;
 
-  if (info->boolOutfile) 
-  {
-    	printf("outfile: %s\n", info->outFile);
-  }
-  else 
-  {
-    	printf("no output redirection.\n");
+    	for( r=info->CommArray[i].redirs; r!=NULL; r=r->next )
+	{
+		printf("Command %d redirects %d%s", i+1, r->fd, types[r->type]);
+		if (r->type == REDIR_DUP)
+			printf("%d\n", r->target);
+		else
+			printf(" %s\n", r->word ? r->word : "");
+	}
   }
   if (info->boolBackground)
   {
@@ -323,7 +864,8 @@ void free_info (parseInfo *info)
   struct commandType *comm;
 
   if( NULL == info) return;
-  for( i=0; i<PIPE_MAX_NUM;i++ ) 
+  if( NULL != info->arena) return;	/* released by arena_reset() */
+  for( i=0; i<=info->pipeNum;i++ ) 
   {
     	comm=&(info->CommArray[i]);
     	for (j=0; j<comm->VarNum; j++) 
@@ -334,7 +876,42 @@ void free_info (parseInfo *info)
 	{
       		free(comm->command);
     	}
+	if (comm->VarList != comm->InlineVars)
+	{
+		free(comm->VarList);
+	}
+	while (comm->redirs != NULL)
+	{
+		struct redirect *next=comm->redirs->next;
+
+		free(comm->redirs->word);
+		free(comm->redirs->body);
+		free(comm->redirs);
+		comm->redirs=next;
+	}
+  }
+  if (info->CommArray != info->InlineComm)
+  {
+	free(info->CommArray);
   }
   free(info);
 }
 
+
+/* -----------------------------------------------------------------------------
+free_list()
+DESCRIPTION:  Releases a list from parse_list() and its pipelines. Nothing is
+done for a list allocated from an arena.
+-------------------------------------------------------------------------------*/
+void free_list( commandList *list )
+{
+  int i;
+
+  if( list == NULL || list->arena != NULL )
+	return;
+  for( i=0; i<list->count; i++ )
+	free_info( list->entries[i].pipeline );
+  if( list->entries != list->InlineEntries )
+	free( list->entries );
+  free( list );
+}
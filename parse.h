@@ -1,29 +1,108 @@
+/* how much is stored inline before the arrays grow, not hard limits */
 #define MAX_VAR_NUM 11
 #define PIPE_MAX_NUM 11
-#define FILE_MAX_SIZE 41
+#define LIST_INLINE_NUM 4
+
+/* per-line arena that a whole parse result can be allocated from */
+struct arenaChunk {
+  struct arenaChunk *next;
+  size_t size;			       /* usable bytes after the header */
+};
+
+typedef struct {
+  struct arenaChunk *chunks;	       /* most recent chunk first */
+  char  *next;			       /* first free byte of chunks */
+  char  *limit;			       /* one past the last byte of chunks */
+  size_t total;			       /* bytes held in all chunks */
+} parseArena;
+
+/* what a redirection does to its descriptor */
+enum redirTypes {
+  REDIR_IN,			       /* N< file */
+  REDIR_OUT,			       /* N> file, truncating it */
+  REDIR_APPEND,			       /* N>> file */
+  REDIR_DUP,			       /* N<&M or N>&M: fd becomes a copy of target */
+  REDIR_CLOSE,			       /* N<&- or N>&- */
+  REDIR_HERESTRING,		       /* N<<< word */
+  REDIR_HEREDOC			       /* N<< delimiter, with the lines up to it */
+};
+
+struct redirect {
+  int type;
+  int fd;			       /* the descriptor redirected */
+  int target;			       /* REDIR_DUP, and a here-document once opened */
+  char *word;			       /* file name, here-string or delimiter */
+  char *body;			       /* REDIR_HEREDOC, read after the line */
+  int quoted;			       /* REDIR_HEREDOC: delimiter was quoted */
+  struct redirect *next;	       /* applied in the order they were written */
+};
 
 struct commandType {
   char *command;
-  char *VarList[MAX_VAR_NUM];
+  char **VarList;		       /* argv, NULL terminated */
   int VarNum;
+  int VarCap;			       /* entries VarList has room for */
+  int builtin;			       /* what the builtin resolver said, 0 if none */
+  int branch;			       /* 0, or which consumer after |& it is part of */
+  struct redirect *redirs;	       /* NULL if there are none */
+  struct redirect *lastRedir;
+  char *InlineVars[MAX_VAR_NUM];       /* VarList until it outgrows it */
 };
 
 /* parsing information structure */
 typedef struct {
-  int   boolInfile;		       /* boolean value - infile specified */
-  int   boolOutfile;		       /* boolean value - outfile specified */
   int   boolBackground;		       /* run the process in the background? */
 
-  struct commandType CommArray[PIPE_MAX_NUM];
+  struct commandType *CommArray;      /* the pipeNum+1 commands */
   int   pipeNum;
-  char  inFile[FILE_MAX_SIZE];	       /* file to be piped from */
-  char  outFile[FILE_MAX_SIZE];	       /* file to be piped into */
+  int   fanOut;			       /* consumers of a |& { , } group, 0 if none */
+  int   commCap;		       /* entries CommArray has room for */
+  parseArena *arena;		       /* owner of everything, NULL if malloc'd */
+  struct commandType InlineComm[PIPE_MAX_NUM]; /* CommArray until it outgrows it */
 } parseInfo;
 
+/* how a pipeline of a command list is joined to the next one */
+enum listOps {
+  LIST_SEQ = 0,			       /* ; & or the end: the next one always runs */
+  LIST_AND,			       /* &&: the next one runs if this one succeeded */
+  LIST_OR			       /* ||: the next one runs if this one failed */
+};
+
+struct listEntry {
+  parseInfo *pipeline;
+  int op;
+};
+
+/* the pipelines of a whole line, in the order they are written */
+typedef struct {
+  struct listEntry *entries;
+  int count;
+  int cap;			       /* entries it has room for */
+  parseArena *arena;		       /* owner of everything, NULL if malloc'd */
+  struct listEntry InlineEntries[LIST_INLINE_NUM]; /* entries until it outgrows them */
+} commandList;
+
+/* tells parse() whether a command name is a builtin: nonzero if so */
+typedef int (*builtinResolver)(const char *);
+
+/* called for every chunk an arena takes from malloc */
+typedef void (*allocCounter)(void);
+
 /* the function prototypes */
 parseInfo *parse(char *);
+parseInfo *parse_arena(char *, parseArena *);
 void free_info(parseInfo *);
+commandList *parse_list(char *, parseArena *);
+void free_list(commandList *);
 void print_info(parseInfo *);
+void parse_set_builtin_resolver(builtinResolver);
+void parse_set_alloc_counter(allocCounter);
+
+void arena_init(parseArena *);
+void arena_reset(parseArena *);
+void arena_free(parseArena *);
+void *arena_alloc(parseArena *, size_t);
+char *arena_strdup(parseArena *, const char *);
 
 
 
@@ -0,0 +1,388 @@
+/* -----------------------------------------------------------------------------
+FILE: parsebench.c
+
+DESCRIPTION: Benchmarks the parser and the command loop of yosh.
+
+The parser is measured on generated corpora, each standing for one kind of
+command line: short everyday commands, long argument lists, deep pipelines,
+redirections and backgrounding, and quoted words. Every corpus is parsed with
+parse() and free_info() and again with parse_arena() and one arena reset per
+line. Every call to malloc, calloc and realloc made by the process is
+counted, so the allocations per line of both modes can be compared directly.
+
+The command loop is measured end to end by running a yosh binary on a script
+of /bin/true lines, once with each launcher, giving commands per second.
+
+Copying is measured by generating a file of the given size and having yosh
+copy it with /bin/cat and with its ycat builtin, into a pipe read by wc -c and
+into a file, giving megabytes per second. The file is written just before, so
+it is in the page cache as far as memory allows.
+
+Every result is one line of key=value pairs in a fixed order, so that runs
+can be diffed or collected by a script:
+	bench=parse corpus=short mode=arena lines=... allocs_per_line=... lines_per_sec=...
+	bench=loop launcher=spawn commands=... commands_per_sec=...
+	bench=copy tool=ycat target=pipe megabytes=... mb_per_sec=...
+
+USAGE: parsebench [-n lines] [-e commands] [-c megabytes] [-y yosh] [lines]
+	-n, or the old positional argument, lines parsed per corpus (default 1000000)
+	-e commands run through yosh per launcher, 0 to skip (default 2000)
+	-c size of the file copied, 0 to skip (default 0; 10240 for the 10 GB run)
+	-y the yosh binary to run (default ./yosh)
+-------------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <wait.h>
+#include "parse.h"
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static unsigned long allocations = 0;
+
+void *malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+	allocations++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+static const char *shortLines[] = { // representative lines of a batch script
+	"ls -l",
+	"grep -v error /var/log/syslog | sort | uniq -c",
+	"cat < input.txt | wc -l > count.txt",
+	"make -j8 all",
+	"cp a.txt b.txt c.txt d.txt e.txt f.txt dest",
+	"sleep 1 &",
+	"echo 'hello world'",
+	"find . -name core | xargs rm -f",
+};
+
+static const char *words[] = { // what the generated lines are made of
+	"src", "build", "main.c", "-v", "--force", "README.md", "/usr/lib", "x86_64",
+	"report-2024.csv", "-o", "out", "tmp", "data.json", "--jobs=8", "lib", "a",
+};
+
+static const char *filters[] = { // pipeline stages
+	"grep -v debug", "sort", "uniq -c", "sort -rn", "head -100", "cut -d: -f1",
+	"tr a-z A-Z", "sed s/x/y/", "awk {print}", "wc -l", "tee copy.log", "cat",
+};
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+#define LINE_MAX_BENCH 8192
+
+static unsigned long seed = 1;
+
+/* -----------------------------------------------------------------------------
+FUNCTION: pick(int n)
+DESCRIPTION: a number below n from a fixed sequence, so that every run
+generates the same corpora
+-------------------------------------------------------------------------------*/
+static int pick(int n) {
+	seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+	return (seed >> 33) % n;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: genShort(char *line)
+DESCRIPTION: one of the everyday lines
+-------------------------------------------------------------------------------*/
+static void genShort(char *line) {
+	strcpy(line, shortLines[pick(COUNT(shortLines))]);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: genLongArgs(char *line)
+DESCRIPTION: a command with 100 to 300 arguments, like a compiler or cp run
+over a directory
+-------------------------------------------------------------------------------*/
+static void genLongArgs(char *line) {
+	int i, n = 100 + pick(201);
+	char *p = line + sprintf(line, "cc -c");
+	for (i = 0; i < n; i++) {
+		p += sprintf(p, " %s/file%04d.c", words[pick(COUNT(words))], i);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: genPipeline(char *line)
+DESCRIPTION: a pipeline of 8 to 24 stages
+-------------------------------------------------------------------------------*/
+static void genPipeline(char *line) {
+	int i, n = 8 + pick(17);
+	char *p = line + sprintf(line, "cat access.log");
+	for (i = 1; i < n; i++) {
+		p += sprintf(p, " | %s", filters[pick(COUNT(filters))]);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: genRedirect(char *line)
+DESCRIPTION: a short pipeline reading from and writing to files, sometimes in
+the background
+-------------------------------------------------------------------------------*/
+static void genRedirect(char *line) {
+	sprintf(line, "%s < %s | %s > %s%s", filters[pick(COUNT(filters))],
+		words[pick(COUNT(words))], filters[pick(COUNT(filters))],
+		words[pick(COUNT(words))], pick(4) == 0 ? " &" : "");
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: genQuoting(char *line)
+DESCRIPTION: a command whose arguments are single and double quoted words
+-------------------------------------------------------------------------------*/
+static void genQuoting(char *line) {
+	int i, n = 2 + pick(6);
+	char *p = line + sprintf(line, "grep");
+	for (i = 0; i < n; i++) {
+		const char *w = words[pick(COUNT(words))];
+		p += sprintf(p, pick(2) ? " '%s$'" : " \"^%s\"", w);
+	}
+}
+
+static struct corpus {
+	const char *name;
+	void (*generate)(char *line);
+} corpora[] = {
+	{ "short", genShort },
+	{ "longargs", genLongArgs },
+	{ "pipeline", genPipeline },
+	{ "redirect", genRedirect },
+	{ "quoting", genQuoting },
+};
+
+/* -----------------------------------------------------------------------------
+FUNCTION: now()
+DESCRIPTION: seconds on the monotonic clock
+-------------------------------------------------------------------------------*/
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: report(const char *corpus, const char *mode, long lines,
+	unsigned long allocs, double secs)
+DESCRIPTION: prints one parser result line
+-------------------------------------------------------------------------------*/
+static void report(const char *corpus, const char *mode, long lines, unsigned long allocs, double secs) {
+	printf("bench=parse corpus=%s mode=%s lines=%ld allocs_per_line=%.3f lines_per_sec=%.0f\n",
+		corpus, mode, lines, (double) allocs / lines, lines / secs);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: benchCorpus(struct corpus *c, long lines)
+DESCRIPTION: generates lines lines of the corpus and parses them in both modes
+-------------------------------------------------------------------------------*/
+static void benchCorpus(struct corpus *c, long lines) {
+	char **script = malloc(lines * sizeof(char *));
+	char line[LINE_MAX_BENCH];
+	parseArena arena;
+	unsigned long before;
+	double start;
+	long i;
+
+	seed = 1;
+	for (i = 0; i < lines; i++) { // the script is built before anything is counted
+		c->generate(line);
+		script[i] = strdup(line);
+	}
+
+	before = allocations;
+	start = now();
+	for (i = 0; i < lines; i++) {
+		free_info(parse(script[i]));
+	}
+	report(c->name, "malloc", lines, allocations - before, now() - start);
+
+	arena_init(&arena);
+	before = allocations;
+	start = now();
+	for (i = 0; i < lines; i++) {
+		arena_reset(&arena);
+		parse_arena(script[i], &arena);
+	}
+	report(c->name, "arena", lines, allocations - before, now() - start);
+	arena_free(&arena);
+
+	for (i = 0; i < lines; i++) {
+		free(script[i]);
+	}
+	free(script);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: runYosh(const char *yosh, const char *option, const char *value,
+	const char *script)
+DESCRIPTION: runs yosh option value [script] and returns how many seconds it
+took, from starting yosh to its exit, or -1 if it did not exit with 0
+-------------------------------------------------------------------------------*/
+static double runYosh(const char *yosh, const char *option, const char *value, const char *script) {
+	double start = now();
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		execl(yosh, yosh, option, value, script, (char *) NULL);
+		perror(yosh);
+		_exit(127);
+	}
+	if (pid == -1 || waitpid(pid, &status, 0) == -1 ||
+			!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+	return now() - start;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: benchLoop(const char *yosh, const char *launcher, long commands)
+DESCRIPTION: runs yosh -l launcher on a script of commands /bin/true lines and
+prints how many it ran per second, from starting yosh to its exit
+-------------------------------------------------------------------------------*/
+static void benchLoop(const char *yosh, const char *launcher, long commands) {
+	char path[] = "/tmp/parsebenchXXXXXX";
+	int fd = mkstemp(path);
+	FILE *fp;
+	double secs;
+	long i;
+
+	if (fd == -1 || (fp = fdopen(fd, "w")) == NULL) {
+		perror("mkstemp");
+		return;
+	}
+	for (i = 0; i < commands; i++) {
+		fputs("/bin/true\n", fp);
+	}
+	fclose(fp);
+
+	secs = runYosh(yosh, "-l", launcher, path);
+	unlink(path);
+	if (secs < 0) {
+		fprintf(stderr, "parsebench: %s -l %s failed\n", yosh, launcher);
+		return;
+	}
+	printf("bench=loop launcher=%s commands=%ld commands_per_sec=%.0f\n",
+		launcher, commands, commands / secs);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: benchCopy(const char *yosh, long megabytes)
+DESCRIPTION: writes a file of megabytes lines of text, then times yosh copying
+it with /bin/cat and with ycat, into a pipe and into another file
+-------------------------------------------------------------------------------*/
+static void benchCopy(const char *yosh, long megabytes) {
+	static const char *tools[] = { "/bin/cat", "ycat" };
+	static const char *targets[] = { "pipe", "file" };
+	static char block[1 << 20];
+	char path[] = "/tmp/parsebenchXXXXXX";
+	char out[sizeof(path) + 4], command[3 * sizeof(path) + 32];
+	int fd = mkstemp(path), len = 0;
+	size_t t, k;
+	double secs;
+	long i;
+
+	if (fd == -1) {
+		perror("mkstemp");
+		return;
+	}
+	for (i = 0; len < (int) sizeof(block) - 64; i++) {
+		len += sprintf(block + len, "%08ld %s %s\n", i, words[i % COUNT(words)],
+			words[(i / 7) % COUNT(words)]);
+	}
+	memset(block + len, '\n', sizeof(block) - len);
+	for (i = 0; i < megabytes; i++) {
+		if (write(fd, block, sizeof(block)) != sizeof(block)) {
+			perror(path);
+			close(fd);
+			unlink(path);
+			return;
+		}
+	}
+	close(fd);
+	snprintf(out, sizeof(out), "%s.out", path);
+
+	for (t = 0; t < COUNT(targets); t++) {
+		for (k = 0; k < COUNT(tools); k++) {
+			if (t == 0) {
+				snprintf(command, sizeof(command), "%s %s | wc -c > /dev/null", tools[k], path);
+			} else {
+				snprintf(command, sizeof(command), "%s %s > %s", tools[k], path, out);
+			}
+			secs = runYosh(yosh, "-c", command, NULL);
+			unlink(out);
+			if (secs < 0) {
+				fprintf(stderr, "parsebench: %s -c '%s' failed\n", yosh, command);
+				continue;
+			}
+			printf("bench=copy tool=%s target=%s megabytes=%ld mb_per_sec=%.0f\n",
+				strrchr(tools[k], '/') != NULL ? strrchr(tools[k], '/') + 1 : tools[k],
+				targets[t], megabytes, megabytes / secs);
+			fflush(stdout);
+		}
+	}
+	unlink(path);
+}
+
+int main(int argc, char **argv) {
+	long lines = 1000000, commands = 2000, megabytes = 0;
+	const char *yosh = "./yosh";
+	int opt;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "n:e:c:y:")) != -1) {
+		switch (opt) {
+		case 'n':
+			lines = atol(optarg);
+			break;
+		case 'e':
+			commands = atol(optarg);
+			break;
+		case 'c':
+			megabytes = atol(optarg);
+			break;
+		case 'y':
+			yosh = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: parsebench [-n lines] [-e commands] [-c megabytes] [-y yosh] [lines]\n");
+			return 2;
+		}
+	}
+	if (optind < argc) {
+		lines = atol(argv[optind]);
+	}
+	if (lines < 1) {
+		lines = 1;
+	}
+
+	for (i = 0; i < COUNT(corpora); i++) {
+		benchCorpus(&corpora[i], lines);
+		fflush(stdout);
+	}
+	if (commands > 0) {
+		benchLoop(yosh, "spawn", commands);
+		benchLoop(yosh, "fork", commands);
+	}
+	if (megabytes > 0) {
+		benchCopy(yosh, megabytes);
+	}
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   prompt.c  -  The interactive prompt of the shell
+ *
+ *   Renders the prompt from the format in $YOSH_PS1, or PROMPT_DEFAULT,
+ *   into a buffer that is kept from one prompt to the next. The rendered
+ *   prompt is only rebuilt when something it shows has changed: the
+ *   working directory (the cd builtin says so), the format, the number of
+ *   jobs or the last exit status. getcwd() is only called after a cd.
+ *
+ *   The format understands these escapes:
+ *	\w  the working directory	\W  its last component
+ *	\~  the working directory with $HOME shown as ~
+ *	\j  the number of jobs		\?  the exit status of the last line
+ *	\u  the user name		\h  the host name, up to the first .
+ *	\$  # for root, $ otherwise	\n  a newline	\\  a backslash
+ *   Any other character is copied as it is.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pwd.h>
+#include "stats.h"
+#include "prompt.h"
+
+static char *rendered = NULL;	       /* the last prompt built */
+static size_t renderedLen = 0;
+static size_t renderedSize = 0;
+static int valid = 0;		       /* rendered matches the state below */
+
+static char cwd[PATH_MAX];
+static int cwdValid = 0;	       /* cleared by prompt_cwd_changed() */
+static char *format = NULL;	       /* copy of the format rendered with */
+static int shownJobs = -1;
+static int shownStatus = -1;
+
+
+/* -----------------------------------------------------------------------------
+prompt_cwd_changed()
+DESCRIPTION:  Tells the prompt that the working directory has changed, so
+that it is looked up again before the next prompt.
+-------------------------------------------------------------------------------*/
+void prompt_cwd_changed( void )
+{
+  cwdValid = 0;
+  valid = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+append()
+DESCRIPTION:  Adds len bytes of s to the rendered prompt, growing the
+buffer when it is too small.
+-------------------------------------------------------------------------------*/
+static void append( const char *s, size_t len )
+{
+  if( renderedLen + len + 1 > renderedSize )
+  {
+	size_t size = renderedSize ? renderedSize : 128;
+	char *grown;
+
+	while( renderedLen + len + 1 > size )
+	  size *= 2;
+	grown = stat_alloc( realloc( rendered, size ) );
+	if( grown == NULL )
+	  return;
+	rendered = grown;
+	renderedSize = size;
+  }
+  memcpy( rendered + renderedLen, s, len );
+  renderedLen += len;
+  rendered[renderedLen] = '\0';
+}
+
+
+/* -----------------------------------------------------------------------------
+append_str()
+DESCRIPTION:  Adds the string s to the rendered prompt.
+-------------------------------------------------------------------------------*/
+static void append_str( const char *s )
+{
+  append( s, strlen( s ) );
+}
+
+
+/* -----------------------------------------------------------------------------
+append_int()
+DESCRIPTION:  Adds the decimal form of n to the rendered prompt.
+-------------------------------------------------------------------------------*/
+static void append_int( int n )
+{
+  char buf[16];
+
+  append( buf, snprintf( buf, sizeof(buf), "%d", n ) );
+}
+
+
+/* -----------------------------------------------------------------------------
+user_name()
+DESCRIPTION:  The name of the user the shell runs as, looked up once.
+-------------------------------------------------------------------------------*/
+static const char *user_name( void )
+{
+  static char *name = NULL;
+
+  if( name == NULL )
+  {
+	struct passwd *pw = getpwuid( getuid() );
+
+	name = stat_alloc( strdup( pw ? pw->pw_name : "?" ) );
+  }
+  return name;
+}
+
+
+/* -----------------------------------------------------------------------------
+host_name()
+DESCRIPTION:  The host name up to its first dot, looked up once.
+-------------------------------------------------------------------------------*/
+static const char *host_name( void )
+{
+  static char name[256] = "";
+
+  if( name[0] == '\0' )
+  {
+	if( gethostname( name, sizeof(name) - 1 ) != 0 )
+	  strcpy( name, "?" );
+	name[strcspn( name, "." )] = '\0';
+  }
+  return name;
+}
+
+
+/* -----------------------------------------------------------------------------
+render()
+DESCRIPTION:  Rebuilds the prompt from fmt.
+-------------------------------------------------------------------------------*/
+static void render( const char *fmt, int jobs, int status )
+{
+  const char *home, *p, *slash;
+  size_t homeLen;
+
+  renderedLen = 0;
+  append( "", 0 );
+  for( p = fmt; *p != '\0'; p++ )
+  {
+	if( *p != '\\' || p[1] == '\0' )
+	{
+	  append( p, 1 );
+	  continue;
+	}
+	switch( *++p )
+	{
+	  case 'w':
+		append_str( cwd );
+		break;
+	  case 'W':
+		slash = strrchr( cwd, '/' );
+		append_str( slash && slash[1] ? slash + 1 : cwd );
+		break;
+	  case '~':
+		home = getenv( "HOME" );
+		homeLen = home ? strlen( home ) : 0;
+		if( homeLen > 1 && strncmp( cwd, home, homeLen ) == 0 &&
+		    (cwd[homeLen] == '/' || cwd[homeLen] == '\0') )
+		{
+		  append( "~", 1 );
+		  append_str( cwd + homeLen );
+		}
+		else
+		  append_str( cwd );
+		break;
+	  case 'j':
+		append_int( jobs );
+		break;
+	  case '?':
+		append_int( status );
+		break;
+	  case 'u':
+		append_str( user_name() );
+		break;
+	  case 'h':
+		append_str( host_name() );
+		break;
+	  case '$':
+		append( geteuid() == 0 ? "#" : "$", 1 );
+		break;
+	  case 'n':
+		append( "\n", 1 );
+		break;
+	  default:		       /* \\ and unknown escapes */
+		append( p, 1 );
+		break;
+	}
+  }
+}
+
+
+/* -----------------------------------------------------------------------------
+prompt_get()
+DESCRIPTION:  Returns the prompt to show, given the number of jobs and the
+exit status of the last line. The string stays valid until the next call.
+-------------------------------------------------------------------------------*/
+const char *prompt_get( int jobs, int status )
+{
+  const char *fmt = getenv( "YOSH_PS1" );
+
+  if( fmt == NULL )
+	fmt = PROMPT_DEFAULT;
+  if( format == NULL || strcmp( format, fmt ) != 0 )
+  {
+	free( format );
+	format = stat_alloc( strdup( fmt ) );
+	valid = 0;
+  }
+  if( jobs != shownJobs || status != shownStatus )
+  {
+	shownJobs = jobs;
+	shownStatus = status;
+	valid = 0;
+  }
+
+  if( !cwdValid )
+  {
+	if( getcwd( cwd, sizeof(cwd) ) == NULL )
+	  strcpy( cwd, "?" );	       /* removed from under us */
+	cwdValid = 1;
+  }
+  if( !valid && format != NULL )
+  {
+	render( format, jobs, status );
+	valid = 1;
+  }
+  return rendered ? rendered : "";
+}
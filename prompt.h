@@ -0,0 +1,7 @@
+/* the cached interactive prompt, see prompt.c */
+
+#define PROMPT_DEFAULT "{yosh}:\\w$ "      /* used when $YOSH_PS1 is not set */
+
+/* the function prototypes */
+const char *prompt_get(int, int);
+void prompt_cwd_changed(void);
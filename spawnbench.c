@@ -0,0 +1,74 @@
+/* -----------------------------------------------------------------------------
+FILE: spawnbench.c
+
+DESCRIPTION: Compares the two ways yosh can start an external command by
+running /bin/true over and over, first with fork + execv + waitpid and then
+with posix_spawn + waitpid. Before measuring, the process grows and touches a
+heap of the given size, standing in for a shell that has been running for a
+while: fork has to copy page tables for all of it, posix_spawn does not.
+
+USAGE: spawnbench [commands] [heap MiB]	(default 2000 commands, 64 MiB)
+-------------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <wait.h>
+
+/* -----------------------------------------------------------------------------
+FUNCTION: now()
+DESCRIPTION: seconds on the monotonic clock
+-------------------------------------------------------------------------------*/
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	long commands = argc > 1 ? atol(argv[1]) : 2000;
+	long heapMiB = argc > 2 ? atol(argv[2]) : 64;
+	char *args[] = { "/bin/true", NULL };
+	char *heap;
+	double start;
+	pid_t pid;
+	long i;
+
+	heap = malloc(heapMiB << 20);
+	if (heap == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	memset(heap, 1, heapMiB << 20); // every page has to be mapped for fork to copy it
+
+	start = now();
+	for (i = 0; i < commands; i++) {
+		pid = fork();
+		if (pid == 0) {
+			execv(args[0], args);
+			_exit(127);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	printf("fork     heap=%ldMiB commands=%ld commands/sec=%.0f\n",
+		heapMiB, commands, commands / (now() - start));
+
+	start = now();
+	for (i = 0; i < commands; i++) {
+		if (posix_spawn(&pid, args[0], NULL, NULL, args, environ) != 0) {
+			perror("posix_spawn");
+			return 1;
+		}
+		waitpid(pid, NULL, 0);
+	}
+	printf("spawn    heap=%ldMiB commands=%ld commands/sec=%.0f\n",
+		heapMiB, commands, commands / (now() - start));
+
+	free(heap);
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   stats.c  -  Counters and latency histograms of the shell itself
+ *
+ *   The shell reads the monotonic clock around every phase of running a
+ *   line and adds the time taken to a histogram of that phase, with one
+ *   bucket per power of two nanoseconds. Events such as forks and reaped
+ *   children are counted with relaxed atomic adds, which need no lock and
+ *   may happen in a signal handler. Allocations are counted where the
+ *   shell makes them, through stat_alloc(); those of readline and the C
+ *   library are not.
+ *
+ *   The yoshstat builtin prints them; with $YOSH_STATS set, they are
+ *   also written to that file as JSON when the shell exits.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "stats.h"
+
+struct phaseStats {
+  unsigned long count;
+  statTime total;		       /* ns */
+  statTime min, max;
+  unsigned long buckets[STAT_BUCKETS];
+};
+
+unsigned long statCounters[STAT_COUNTERS];
+static struct phaseStats phases[STAT_PHASES];
+
+static const char *phaseNames[STAT_PHASES] = {
+  "read", "histexpand", "parse", "expand", "launch", "wait", "builtin"
+};
+static const char *counterNames[STAT_COUNTERS] = {
+  "lines", "forks", "spawns", "execs", "builtins", "reaped", "allocs", "dirreads"
+};
+
+static char *exitFile = NULL;	       /* where to write the JSON at exit */
+static pid_t exitPid;		       /* only the shell writes it, not its children */
+
+
+/* -----------------------------------------------------------------------------
+stat_count_alloc()
+DESCRIPTION:  Counts one allocation, for modules that cannot use stat_alloc()
+because they are also linked without stats.c, such as the parser's arena.
+-------------------------------------------------------------------------------*/
+void stat_count_alloc( void )
+{
+  stat_count( STAT_ALLOCS );
+}
+
+
+/* -----------------------------------------------------------------------------
+stat_clock()
+DESCRIPTION:  Nanoseconds on the monotonic clock, to be handed back to
+stat_phase() when the phase is over.
+-------------------------------------------------------------------------------*/
+statTime stat_clock( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (statTime) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+
+/* -----------------------------------------------------------------------------
+stat_phase()
+DESCRIPTION:  Records that phase took from start, a stat_clock() reading,
+until now. Only called by the shell's main thread.
+-------------------------------------------------------------------------------*/
+void stat_phase( int phase, statTime start )
+{
+  struct phaseStats *p = &phases[phase];
+  statTime ns = stat_clock() - start;
+  int bucket = 63 - __builtin_clzll( ns | 1 );
+
+  if( bucket >= STAT_BUCKETS )
+	bucket = STAT_BUCKETS - 1;
+  p->buckets[bucket]++;
+  if( p->count == 0 || ns < p->min )
+	p->min = ns;
+  if( ns > p->max )
+	p->max = ns;
+  p->count++;
+  p->total += ns;
+}
+
+
+/* -----------------------------------------------------------------------------
+percentile()
+DESCRIPTION:  An estimate of the given percentile of a phase: the upper
+bound of the bucket it falls in, but no more than the slowest time seen.
+-------------------------------------------------------------------------------*/
+static statTime percentile( struct phaseStats *p, int pct )
+{
+  unsigned long seen = 0, want = (p->count * pct + 99) / 100;
+  int i;
+
+  for( i = 0; i < STAT_BUCKETS; i++ )
+  {
+	seen += p->buckets[i];
+	if( seen >= want )
+	  break;
+  }
+  if( i >= STAT_BUCKETS - 1 || (2ull << i) > p->max )
+	return p->max;
+  return 2ull << i;
+}
+
+
+/* -----------------------------------------------------------------------------
+stat_print()
+DESCRIPTION:  Writes the counters and the phases to out, as a table, or as
+one JSON object with every histogram bucket when json is set.
+-------------------------------------------------------------------------------*/
+void stat_print( FILE *out, int json )
+{
+  struct phaseStats *p;
+  int i, j, last;
+
+  if( json )
+  {
+	fprintf( out, "{\"counters\":{" );
+	for( i = 0; i < STAT_COUNTERS; i++ )
+	  fprintf( out, "%s\"%s\":%lu", i ? "," : "", counterNames[i],
+		   __atomic_load_n( &statCounters[i], __ATOMIC_RELAXED ) );
+	fprintf( out, "},\"phases\":{" );
+	for( i = 0; i < STAT_PHASES; i++ )
+	{
+	  p = &phases[i];
+	  fprintf( out, "%s\"%s\":{\"count\":%lu,\"total_ns\":%llu,\"min_ns\":%llu,"
+		   "\"max_ns\":%llu,\"buckets\":[", i ? "," : "", phaseNames[i],
+		   p->count, p->total, p->min, p->max );
+	  for( last = STAT_BUCKETS - 1; last > 0 && p->buckets[last] == 0; last-- );
+	  for( j = 0; j <= last; j++ )
+		fprintf( out, "%s%lu", j ? "," : "", p->buckets[j] );
+	  fprintf( out, "]}" );
+	}
+	fprintf( out, "}}\n" );
+	return;
+  }
+
+  for( i = 0; i < STAT_COUNTERS; i++ )
+	fprintf( out, "%-10s %lu\n", counterNames[i],
+		 __atomic_load_n( &statCounters[i], __ATOMIC_RELAXED ) );
+  fprintf( out, "\n%-10s %8s %10s %10s %10s %10s %10s %10s\n", "phase",
+	   "count", "total ms", "mean us", "min us", "p50 us", "p99 us", "max us" );
+  for( i = 0; i < STAT_PHASES; i++ )
+  {
+	p = &phases[i];
+	if( p->count == 0 )
+	  continue;
+	fprintf( out, "%-10s %8lu %10.3f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		 phaseNames[i], p->count, p->total / 1e6, p->total / 1e3 / p->count,
+		 p->min / 1e3, percentile( p, 50 ) / 1e3, percentile( p, 99 ) / 1e3,
+		 p->max / 1e3 );
+  }
+}
+
+
+/* -----------------------------------------------------------------------------
+stat_reset()
+DESCRIPTION:  Sets every counter and histogram back to zero.
+-------------------------------------------------------------------------------*/
+void stat_reset( void )
+{
+  int i;
+
+  for( i = 0; i < STAT_COUNTERS; i++ )
+	__atomic_store_n( &statCounters[i], 0, __ATOMIC_RELAXED );
+  memset( phases, 0, sizeof(phases) );
+}
+
+
+/* -----------------------------------------------------------------------------
+write_exit_file()
+DESCRIPTION:  The atexit() handler of stat_write_on_exit().
+-------------------------------------------------------------------------------*/
+static void write_exit_file( void )
+{
+  FILE *fp;
+
+  if( getpid() != exitPid )	       /* a child forked for a builtin */
+	return;
+  fp = fopen( exitFile, "w" );
+  if( fp == NULL )
+  {
+	perror( exitFile );
+	return;
+  }
+  stat_print( fp, 1 );
+  fclose( fp );
+}
+
+
+/* -----------------------------------------------------------------------------
+stat_write_on_exit()
+DESCRIPTION:  Makes the shell write the counters and histograms to path as
+JSON when it exits.
+-------------------------------------------------------------------------------*/
+void stat_write_on_exit( const char *path )
+{
+  exitFile = strdup( path );
+  exitPid = getpid();
+  if( exitFile != NULL )
+	atexit( write_exit_file );
+}
@@ -0,0 +1,45 @@
+/* counters and latency histograms of the shell itself, see stats.c */
+
+enum statPhases {		       /* timed parts of running a line */
+  STAT_READ = 0,		       /* readline, or reading a batch line */
+  STAT_HISTEXPAND,
+  STAT_PARSE,
+  STAT_EXPAND,			       /* ~ and $ expansion, quote removal */
+  STAT_LAUNCH,			       /* starting the stages of a pipeline */
+  STAT_WAIT,			       /* waiting for a foreground pipeline */
+  STAT_BUILTIN,			       /* a builtin run inside the shell */
+  STAT_PHASES
+};
+
+enum statCounters {
+  STAT_LINES = 0,
+  STAT_FORKS,
+  STAT_SPAWNS,
+  STAT_EXECS,			       /* external commands started either way */
+  STAT_BUILTINS,
+  STAT_REAPED,			       /* children reaped */
+  STAT_ALLOCS,			       /* the shell's own mallocs, callocs and reallocs */
+  STAT_DIRREADS,		       /* directories read for globbing */
+  STAT_COUNTERS
+};
+
+#define STAT_BUCKETS 40		       /* bucket i counts [2^i, 2^(i+1)) ns */
+
+extern unsigned long statCounters[STAT_COUNTERS];
+
+/* counts one event; lock-free, so safe in signal handlers and threads */
+#define stat_count(counter) \
+  __atomic_fetch_add( &statCounters[counter], 1, __ATOMIC_RELAXED )
+
+/* wraps an allocation call of the shell's own, as in stat_alloc( malloc( n ) ) */
+#define stat_alloc(call) (stat_count( STAT_ALLOCS ), (call))
+
+typedef unsigned long long statTime;
+
+/* the function prototypes */
+statTime stat_clock(void);
+void stat_phase(int, statTime);
+void stat_print(FILE *, int);
+void stat_reset(void);
+void stat_write_on_exit(const char *);
+void stat_count_alloc(void);
@@ -0,0 +1,691 @@
+/*******************************************************************************
+ *******************************************************************************
+ *   yglob.c  -  Pathname expansion
+ *
+ *   Expands a word with unquoted * ? or [...] in it into the sorted list
+ *   of the paths it matches. Each component of the pattern that has
+ *   wildcards is compiled once into a list of match operations, with a
+ *   literal suffix such as the .log of *.log checked before anything
+ *   else, and run against every name of its directory.
+ *
+ *   Directories are read with getdents64() into one block per directory,
+ *   sorted once, and kept in a small cache keyed by device, inode and
+ *   mtime: globbing again in a directory that has not changed since costs
+ *   one stat(). A listing read less than a second after the directory was
+ *   last changed is not trusted again, since a change made within the same
+ *   timestamp tick would not show in its mtime.
+ *
+ *   As in sh, names starting with a . are only matched by a pattern that
+ *   starts with one, . and .. are never matched, and a pattern matching
+ *   nothing is left to the caller to keep as it is.
+ *
+ *******************************************************************************
+ *******************************************************************************/
+
+#define _GNU_SOURCE		       /* syscall() */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "parse.h"
+#include "stats.h"
+#include "yglob.h"
+
+#define DIR_CACHE_SLOTS 16
+#define DENTS_BUFFER 65536
+
+struct linuxDirent64 {		       /* what getdents64() fills its buffer with */
+  unsigned long long d_ino;
+  long long d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+struct dirEntry {
+  const char *name;
+  unsigned int len;
+  unsigned char type;		       /* DT_DIR, DT_LNK, DT_UNKNOWN ... */
+};
+
+struct dirListing {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  int trusted;			       /* may be used again while mtime holds */
+  int inUse;			       /* being walked, not to be evicted */
+  int temporary;		       /* not in the cache, freed after use */
+  unsigned long lastUse;	       /* 0 while the slot is empty */
+  char *names;			       /* every name, NUL terminated */
+  struct dirEntry *entries;	       /* sorted by name */
+  int count;
+};
+
+enum { OP_CHAR, OP_ANY, OP_STAR, OP_CLASS };
+
+struct matchOp {
+  unsigned char type;
+  unsigned char c;		       /* OP_CHAR */
+  unsigned char *class;		       /* OP_CLASS: 256 bit set */
+};
+
+struct matcher {
+  struct matchOp *ops;
+  int count;
+  int minLen;			       /* characters any match has at least */
+  const char *suffix;		       /* literal tail after the last *, or NULL */
+  int suffixLen;
+  int dotOk;			       /* pattern starts with a literal . */
+  unsigned char *classes;	       /* the sets of every OP_CLASS */
+};
+
+static struct dirListing cache[DIR_CACHE_SLOTS];
+static unsigned long useClock = 0;
+
+static char **results = NULL;	       /* paths found by the current yglob_expand() */
+static int resultCount = 0;
+static int resultCap = 0;
+
+static char path[PATH_MAX + 1];	       /* the path being built */
+
+
+/* -----------------------------------------------------------------------------
+has_wildcards()
+DESCRIPTION:  Whether the len bytes of a pattern component have an
+unescaped * ? or [ in them.
+-------------------------------------------------------------------------------*/
+static int has_wildcards( const char *s, size_t len )
+{
+  size_t i;
+
+  for( i = 0; i < len; i++ )
+  {
+	if( s[i] == '\\' )
+	  i++;
+	else if( s[i] == '*' || s[i] == '?' || s[i] == '[' )
+	  return 1;
+  }
+  return 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+compile_class()
+DESCRIPTION:  Compiles the bracket expression starting at s[i], a [, into
+set, and returns the index just past its ], or -1 if it is not closed, in
+which case the [ is an ordinary character.
+-------------------------------------------------------------------------------*/
+static int compile_class( const char *s, int len, int i, unsigned char *set )
+{
+  static const struct { const char *name; int (*is)( int ); } named[] = {
+	{ "alpha", isalpha }, { "digit", isdigit }, { "alnum", isalnum },
+	{ "upper", isupper }, { "lower", islower }, { "space", isspace },
+	{ "punct", ispunct }, { "xdigit", isxdigit }
+  };
+  int negate = 0, first, c, hi, k, n;
+
+  memset( set, 0, 32 );
+  i++;
+  if( i < len && (s[i] == '!' || s[i] == '^') )
+  {
+	negate = 1;
+	i++;
+  }
+  for( first = i; i < len && (s[i] != ']' || i == first); )
+  {
+	if( s[i] == '[' && i + 1 < len && s[i + 1] == ':' )
+	{
+	  for( k = 0; k < (int) (sizeof(named) / sizeof(named[0])); k++ )
+	  {
+		n = strlen( named[k].name );
+		if( i + 2 + n + 1 < len && strncmp( s + i + 2, named[k].name, n ) == 0 &&
+		    s[i + 2 + n] == ':' && s[i + 3 + n] == ']' )
+		  break;
+	  }
+	  if( k < (int) (sizeof(named) / sizeof(named[0])) )
+	  {
+		for( c = 0; c < 256; c++ )
+		  if( named[k].is( c ) )
+			set[c >> 3] |= 1 << (c & 7);
+		i += 4 + strlen( named[k].name );
+		continue;
+	  }
+	}
+	if( s[i] == '\\' && i + 1 < len )
+	  i++;
+	c = (unsigned char) s[i++];
+	hi = c;
+	if( i + 1 < len && s[i] == '-' && s[i + 1] != ']' )
+	{
+	  i++;
+	  if( s[i] == '\\' && i + 1 < len )
+		i++;
+	  hi = (unsigned char) s[i++];
+	}
+	for( ; c <= hi; c++ )
+	  set[c >> 3] |= 1 << (c & 7);
+  }
+  if( i >= len )
+	return -1;
+  if( negate )
+	for( k = 0; k < 32; k++ )
+	  set[k] = ~set[k];
+  return i + 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+compile()
+DESCRIPTION:  Compiles the len bytes of one pattern component into m.
+Returns -1 if memory runs out.
+-------------------------------------------------------------------------------*/
+static int compile( const char *s, int len, struct matcher *m )
+{
+  unsigned char *classes;
+  int i = 0, next, lastStar = -1, classCount = 0;
+
+  memset( m, 0, sizeof(*m) );
+  m->ops = stat_alloc( malloc( len * sizeof(struct matchOp) ) );
+  classes = stat_alloc( malloc( len * 32 ) );
+  if( m->ops == NULL || classes == NULL )
+  {
+	free( m->ops );
+	free( classes );
+	return -1;
+  }
+  m->dotOk = s[0] == '.' || (s[0] == '\\' && len > 1 && s[1] == '.');
+
+  while( i < len )
+  {
+	struct matchOp *op = &m->ops[m->count];
+
+	op->class = NULL;
+	if( s[i] == '*' )
+	{
+	  i++;
+	  if( m->count > 0 && m->ops[m->count - 1].type == OP_STAR )
+		continue;
+	  op->type = OP_STAR;
+	  lastStar = m->count;
+	}
+	else if( s[i] == '?' )
+	{
+	  i++;
+	  op->type = OP_ANY;
+	}
+	else if( s[i] == '[' &&
+		 (next = compile_class( s, len, i, classes + 32 * classCount )) > 0 )
+	{
+	  i = next;
+	  op->type = OP_CLASS;
+	  op->class = classes + 32 * classCount++;
+	}
+	else
+	{
+	  if( s[i] == '\\' && i + 1 < len )
+		i++;
+	  op->type = OP_CHAR;
+	  op->c = s[i++];
+	}
+	if( op->type != OP_STAR )
+	  m->minLen++;
+	m->count++;
+  }
+  if( classCount == 0 )
+  {
+	free( classes );
+	classes = NULL;
+  }
+
+  /* a tail of plain characters after the last * rejects most names early */
+  if( lastStar >= 0 )
+  {
+	for( i = lastStar + 1; i < m->count && m->ops[i].type == OP_CHAR; i++ );
+	if( i == m->count && m->count > lastStar + 1 )
+	{
+	  char *suffix = stat_alloc( malloc( m->count - lastStar ) );
+
+	  if( suffix != NULL )
+	  {
+		for( i = lastStar + 1; i < m->count; i++ )
+		  suffix[i - lastStar - 1] = m->ops[i].c;
+		m->suffix = suffix;
+		m->suffixLen = m->count - lastStar - 1;
+	  }
+	}
+  }
+  m->classes = classes;
+  return 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+free_matcher()
+DESCRIPTION:  Frees what compile() allocated.
+-------------------------------------------------------------------------------*/
+static void free_matcher( struct matcher *m )
+{
+  free( m->classes );
+  free( m->ops );
+  free( (char *) m->suffix );
+}
+
+
+/* -----------------------------------------------------------------------------
+matches()
+DESCRIPTION:  Whether the name of len bytes matches m. A * first matches
+nothing, and only takes one more character when what follows it fails,
+going back to the last * only; this never takes more than length of name
+times length of pattern steps.
+-------------------------------------------------------------------------------*/
+static int matches( const struct matcher *m, const char *name, unsigned int len )
+{
+  const struct matchOp *ops = m->ops;
+  int i = 0, star = -1;
+  unsigned int p = 0, starP = 0;
+
+  if( name[0] == '.' && !m->dotOk )
+	return 0;
+  if( len < (unsigned int) m->minLen )
+	return 0;
+  if( m->suffix != NULL &&
+      memcmp( name + len - m->suffixLen, m->suffix, m->suffixLen ) != 0 )
+	return 0;
+
+  while( p < len )
+  {
+	unsigned char c = name[p];
+
+	if( i < m->count && ops[i].type == OP_STAR )
+	{
+	  star = ++i;
+	  starP = p;
+	  continue;
+	}
+	if( i < m->count &&
+	    (ops[i].type == OP_ANY ||
+	     (ops[i].type == OP_CHAR && ops[i].c == c) ||
+	     (ops[i].type == OP_CLASS && (ops[i].class[c >> 3] & (1 << (c & 7))))) )
+	{
+	  i++;
+	  p++;
+	  continue;
+	}
+	if( star < 0 )
+	  return 0;
+	i = star;
+	p = ++starP;
+  }
+  while( i < m->count && ops[i].type == OP_STAR )
+	i++;
+  return i == m->count;
+}
+
+
+/* -----------------------------------------------------------------------------
+compare_entries()
+DESCRIPTION:  qsort() order of the entries of a listing.
+-------------------------------------------------------------------------------*/
+static int compare_entries( const void *a, const void *b )
+{
+  return strcmp( ((const struct dirEntry *) a)->name, ((const struct dirEntry *) b)->name );
+}
+
+
+/* -----------------------------------------------------------------------------
+read_listing()
+DESCRIPTION:  Reads the directory open on fd into l with getdents64(),
+leaving out . and .., and sorts it. Returns -1 if it cannot be read.
+-------------------------------------------------------------------------------*/
+static int read_listing( int fd, struct dirListing *l )
+{
+  static char *buffer = NULL;
+  size_t used = 0, size = 0;
+  int cap = 0, i;
+  long n, pos;
+
+  if( buffer == NULL && (buffer = stat_alloc( malloc( DENTS_BUFFER ) )) == NULL )
+	return -1;
+  stat_count( STAT_DIRREADS );
+
+  while( (n = syscall( SYS_getdents64, fd, buffer, DENTS_BUFFER )) > 0 )
+  {
+	for( pos = 0; pos < n; pos += ((struct linuxDirent64 *) (buffer + pos))->d_reclen )
+	{
+	  struct linuxDirent64 *d = (struct linuxDirent64 *) (buffer + pos);
+	  size_t len = strlen( d->d_name );
+
+	  if( d->d_name[0] == '.' &&
+	      (len == 1 || (len == 2 && d->d_name[1] == '.')) )
+		continue;
+	  if( used + len + 1 > size )
+	  {
+		char *grown;
+
+		size = size ? size * 2 : 16384;
+		while( used + len + 1 > size )
+		  size *= 2;
+		if( (grown = stat_alloc( realloc( l->names, size ) )) == NULL )
+		  return -1;
+		l->names = grown;
+	  }
+	  if( l->count == cap )
+	  {
+		struct dirEntry *grown;
+
+		cap = cap ? cap * 2 : 256;
+		if( (grown = stat_alloc( realloc( l->entries, cap * sizeof(struct dirEntry) ) )) == NULL )
+		  return -1;
+		l->entries = grown;
+	  }
+	  memcpy( l->names + used, d->d_name, len + 1 );
+	  l->entries[l->count].name = (const char *) used;	/* an offset until names stops moving */
+	  l->entries[l->count].len = len;
+	  l->entries[l->count].type = d->d_type;
+	  l->count++;
+	  used += len + 1;
+	}
+  }
+  if( n < 0 )
+	return -1;
+
+  for( i = 0; i < l->count; i++ )
+	l->entries[i].name = l->names + (size_t) l->entries[i].name;
+  qsort( l->entries, l->count, sizeof(struct dirEntry), compare_entries );
+  return 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+get_listing()
+DESCRIPTION:  The sorted listing of the directory dir, from the cache if it
+has not changed since it was read, or NULL if it cannot be read. It stays
+in the cache until release_listing(); when every slot is held by the
+directories above, the listing is read outside the cache.
+-------------------------------------------------------------------------------*/
+static struct dirListing *get_listing( const char *dir )
+{
+  struct dirListing *l, *victim = NULL;
+  struct timespec now;
+  struct stat st;
+  int fd, i;
+
+  if( stat( dir, &st ) == -1 || !S_ISDIR( st.st_mode ) )
+	return NULL;
+
+  for( i = 0; i < DIR_CACHE_SLOTS; i++ )
+  {
+	l = &cache[i];
+	if( l->lastUse != 0 && l->dev == st.st_dev && l->ino == st.st_ino && !l->inUse )
+	{
+	  if( l->trusted && l->mtime.tv_sec == st.st_mtim.tv_sec &&
+	      l->mtime.tv_nsec == st.st_mtim.tv_nsec )
+	  {
+		l->lastUse = ++useClock;
+		l->inUse = 1;
+		return l;
+	  }
+	  victim = l;		       /* stale, read it again in place */
+	  break;
+	}
+	if( !l->inUse && (victim == NULL || l->lastUse < victim->lastUse) )
+	  victim = l;
+  }
+
+  if( victim != NULL )
+  {
+	l = victim;
+	free( l->names );
+	free( l->entries );
+	memset( l, 0, sizeof(*l) );
+  }
+  else if( (l = stat_alloc( calloc( 1, sizeof(*l) ) )) == NULL )
+	return NULL;
+  else
+	l->temporary = 1;
+
+  clock_gettime( CLOCK_REALTIME, &now );
+  fd = open( dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+  if( fd == -1 || read_listing( fd, l ) == -1 )
+  {
+	int temporary = l->temporary;
+
+	if( fd != -1 )
+	  close( fd );
+	free( l->names );
+	free( l->entries );
+	memset( l, 0, sizeof(*l) );
+	if( temporary )
+	  free( l );
+	return NULL;
+  }
+  close( fd );
+
+  l->dev = st.st_dev;
+  l->ino = st.st_ino;
+  l->mtime = st.st_mtim;
+  l->trusted = now.tv_sec > st.st_mtim.tv_sec + 1;
+  l->lastUse = ++useClock;
+  l->inUse = 1;
+  return l;
+}
+
+
+/* -----------------------------------------------------------------------------
+release_listing()
+DESCRIPTION:  Hands back a listing from get_listing().
+-------------------------------------------------------------------------------*/
+static void release_listing( struct dirListing *l )
+{
+  if( l->temporary )
+  {
+	free( l->names );
+	free( l->entries );
+	free( l );
+  }
+  else
+	l->inUse = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+add_result()
+DESCRIPTION:  Adds the len bytes of path to the results, allocated from
+arena.
+-------------------------------------------------------------------------------*/
+static void add_result( size_t len, parseArena *arena )
+{
+  char *copy;
+
+  if( resultCount == resultCap )
+  {
+	char **grown;
+	int cap = resultCap ? resultCap * 2 : 64;
+
+	if( (grown = stat_alloc( realloc( results, cap * sizeof(char *) ) )) == NULL )
+	  return;
+	results = grown;
+	resultCap = cap;
+  }
+  if( (copy = arena_alloc( arena, len + 1 )) == NULL )
+	return;
+  memcpy( copy, path, len );
+  copy[len] = '\0';
+  results[resultCount++] = copy;
+}
+
+
+/* -----------------------------------------------------------------------------
+is_directory()
+DESCRIPTION:  Whether the entry e, whose path is in path, is a directory or
+a link to one. Only needs a stat() when getdents64() could not tell.
+-------------------------------------------------------------------------------*/
+static int is_directory( const struct dirEntry *e )
+{
+  struct stat st;
+
+  if( e->type == DT_DIR )
+	return 1;
+  if( e->type != DT_LNK && e->type != DT_UNKNOWN )
+	return 0;
+  return stat( path, &st ) == 0 && S_ISDIR( st.st_mode );
+}
+
+
+/* -----------------------------------------------------------------------------
+walk()
+DESCRIPTION:  Finds the paths matching the components from the n'th on,
+below the directory whose path is the first len bytes of path. A trailing
+empty component stands for a pattern ending in /, which only directories
+match.
+-------------------------------------------------------------------------------*/
+static void walk( char **comps, int *lens, int n, int count, size_t len, parseArena *arena )
+{
+  struct dirListing *l;
+  struct matcher m;
+  int last = n == count - 1, i;
+
+  if( n == count )
+  {
+	add_result( len, arena );
+	return;
+  }
+  if( lens[n] == 0 )		       /* the pattern ended in a / */
+  {
+	struct stat st;
+
+	path[len] = '\0';
+	if( stat( len ? path : ".", &st ) == 0 && S_ISDIR( st.st_mode ) )
+	  add_result( len, arena );
+	return;
+  }
+
+  if( !has_wildcards( comps[n], lens[n] ) )
+  {
+	struct stat st;
+
+	for( i = 0; i < lens[n] && len < PATH_MAX - 1; i++ )
+	{
+	  if( comps[n][i] == '\\' && i + 1 < lens[n] )
+		i++;
+	  path[len++] = comps[n][i];
+	}
+	path[len] = '\0';
+	if( last && lstat( path, &st ) == -1 )
+	  return;
+	if( !last )
+	  path[len++] = '/';
+	walk( comps, lens, n + 1, count, len, arena );
+	return;
+  }
+
+  path[len] = '\0';
+  if( (l = get_listing( len ? path : "." )) == NULL )
+	return;
+  if( compile( comps[n], lens[n], &m ) == -1 )
+  {
+	release_listing( l );
+	return;
+  }
+  for( i = 0; i < l->count; i++ )
+  {
+	const struct dirEntry *e = &l->entries[i];
+
+	if( !matches( &m, e->name, e->len ) || len + e->len + 2 > PATH_MAX )
+	  continue;
+	memcpy( path + len, e->name, e->len + 1 );
+	if( last )
+	  add_result( len + e->len, arena );
+	else if( is_directory( e ) )
+	{
+	  path[len + e->len] = '/';
+	  walk( comps, lens, n + 1, count, len + e->len + 1, arena );
+	}
+  }
+  free_matcher( &m );
+  release_listing( l );
+}
+
+
+/* -----------------------------------------------------------------------------
+compare_paths()
+DESCRIPTION:  qsort() order of the results.
+-------------------------------------------------------------------------------*/
+static int compare_paths( const void *a, const void *b )
+{
+  return strcmp( *(char * const *) a, *(char * const *) b );
+}
+
+
+/* -----------------------------------------------------------------------------
+yglob_expand()
+DESCRIPTION:  Finds the paths matching pattern, in which a backslash makes
+the character after it an ordinary one. Returns how many there are, with
+*matches set to a sorted NULL terminated array of them allocated from
+arena, or 0 when nothing matches.
+-------------------------------------------------------------------------------*/
+int yglob_expand( const char *pattern, parseArena *arena, char ***matches )
+{
+  char *comps[PATH_MAX / 2 + 1];
+  int lens[PATH_MAX / 2 + 1];
+  int count = 0, globbed = 0, i;
+  size_t len = 0;
+  const char *p = pattern;
+
+  *matches = NULL;
+  if( strlen( pattern ) > PATH_MAX )
+	return 0;
+  if( *p == '/' )
+  {
+	path[len++] = '/';
+	while( *p == '/' )
+	  p++;
+  }
+  while( *p != '\0' )
+  {
+	const char *start = p;
+
+	while( *p != '\0' && *p != '/' )
+	  p++;
+	comps[count] = (char *) start;
+	lens[count] = p - start;
+	globbed += has_wildcards( start, p - start );
+	count++;
+	if( *p == '/' )
+	{
+	  while( *p == '/' )
+		p++;
+	  if( *p == '\0' )	       /* a trailing /, kept as an empty component */
+	  {
+		comps[count] = (char *) p;
+		lens[count++] = 0;
+	  }
+	}
+  }
+  if( globbed == 0 )
+	return 0;
+
+  resultCount = 0;
+  walk( comps, lens, 0, count, len, arena );
+  if( resultCount == 0 )
+	return 0;
+
+  /* one listing walked in order is sorted already, several need not be */
+  if( globbed > 1 )
+	qsort( results, resultCount, sizeof(char *), compare_paths );
+  *matches = arena_alloc( arena, (resultCount + 1) * sizeof(char *) );
+  if( *matches == NULL )
+	return 0;
+  for( i = 0; i < resultCount; i++ )
+	(*matches)[i] = results[i];
+  (*matches)[resultCount] = NULL;
+  return resultCount;
+}
@@ -0,0 +1,4 @@
+/* pathname expansion with a cache of directory listings, see yglob.c */
+
+/* the function prototypes */
+int yglob_expand(const char *, parseArena *, char ***);
@@ -8,21 +8,37 @@ elements. This includes the jobs, exit, history, kill, cd, and help commands.
 This shell also supports 
 -------------------------------------------------------------------------------*/
 
+#define _GNU_SOURCE // pipe2() and the other Linux-specific calls
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include "parse.h" // local file include declarations for parse-related structs
+#include "hash.h" // the command path hash table
+#include "prompt.h" // the cached prompt
+#include "histstore.h" // the history file
+#include "stats.h" // counters and latency histograms of the shell
+#include "expand.h" // ~, $ and quote handling of words
+#include "yglob.h" // *, ? and [...] in words
+#include "fdcopy.h" // copying between descriptors inside the kernel
 #include <wait.h>
 #include <stdbool.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <wordexp.h>
+#include <sys/mman.h>
 #include <limits.h>
 #include <signal.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <poll.h>
 
 enum BUILTIN_COMMANDS
 {
@@ -32,628 +48,3117 @@ enum BUILTIN_COMMANDS
 	HISTORY,
 	KILL,
 	CD,
-	HELP
+	HELP,
+	HASH,
+	WAIT,
+	YOSHSTAT,
+	YCAT,
+	PARALLEL
+};
+
+enum JOB_MODES
+{
+	JOB_RUNNING = 0,
+	JOB_FINISHED // every stage has exited, it is removed once reported
 };
 
-struct job { // an object to hold all the relevant information to create a linked list and job storage
-	int num;
+struct job { // a background job, living in a slot of the job table
+	int num; // slot + 1, or 0 while the slot is free
 	char *command;
-	pid_t pid;
+	pid_t pid; // the first stage, which leads the process group
 	int mode;
-	struct job *nextjob;
+	pid_t *pids; // every forked stage
+	int stages; // entries in pids
+	int stagesLeft; // stages that have not exited yet
+	int status; // wait status of the last stage, once it exited
+	struct rusage usage; // summed over the stages that exited
+	int nextFree; // next slot on the free list, while this one is free
+	int outFd; // with -b, the pipe its output is captured from, -1 once at end of file
+	char *output; // ring of the last JOB_OUTPUT_SIZE bytes, NULL until it wrote any
+	size_t outHead; // where the next byte goes in output
+	size_t outLen; // bytes held in output
+	unsigned long outTotal; // bytes it wrote in all, more than outLen once the ring wrapped
+	int reported; // finished and announced, kept until its output is shown
+};
+
+struct pidEntry { // maps the pid of a stage to the slot of its job
+	pid_t pid; // 0 when empty
+	int slot;
+};
+
+struct jobs { // the job table
+	struct job *slots;
+	int cap;
+	int used; // slots that have ever been handed out, from the start
+	int count; // jobs in the table
+	int freeList; // a free slot below used, or -1
+	struct pidEntry *pidIndex; // open addressing, linear probing
+	int pidCap; // a power of two
+	int pidCount;
+};
+
+#define CHILD_EVENT_MAX 64
+
+struct childEvent { // what handle_sigchld() learned about a child that exited
+	pid_t pid;
+	int status;
+	struct rusage usage;
+	struct timespec when; // CLOCK_MONOTONIC, when it was reaped
+};
+
+struct stageTimes { // what the time keyword reports about a stage
+	struct rusage usage;
+	struct timespec end;
+};
+
+enum TIME_FORMATS // how the time keyword reports
+{
+	TIME_NONE = 0, // the line is not timed
+	TIME_HUMAN,
+	TIME_POSIX, // time -p
+	TIME_JSON // time -j
+};
+
+struct foreground { // the pipeline watchPipeline() recorded for waitPipeline()
+	pid_t *pids;
+	int *statuses;
+	struct stageTimes *times; // NULL unless the pipeline is timed
+	int n;
+	int left; // stages that have not exited yet
 };
 
-struct job *head; // the very start of the jobs linked list
+struct workerPool { // the commands the parallel builtin is running, by worker slot
+	pid_t *pids; // 0 while the slot is free
+	int *statuses; // -1 until the command in the slot exits
+	int n;
+	int exited; // slots whose command exited since parallel last looked
+};
+
+struct jobs jobTable = { NULL, 0, 0, 0, -1, NULL, 0, 0 };
 int modHistory = 0;
+int sharedHistory = 0; // pick up the lines other shells append to the history file
+long historySeen = 0; // entries of the history file already in readline
+#define HISTORY_DEFAULT_SIZE 10 // entries kept in readline, and listed by history, without -s
+int interactive = 0; // whether the shell owns a terminal and does job control on it
+int lastStatus = 0; // exit status of the last command line
+sigset_t origMask; // the signal mask the shell started with, restored in children
+sigset_t chldMask; // just SIGCHLD, blocked while a foreground pipeline runs
+
+struct childEvent childEvents[CHILD_EVENT_MAX]; // ring filled by handle_sigchld(), one slot always free
+volatile sig_atomic_t eventHead = 0; // next slot handle_sigchld() fills
+volatile sig_atomic_t eventTail = 0; // next slot drainChildEvents() reads
+int selfPipe[2] = { -1, -1 }; // handle_sigchld() writes a byte here, for code that polls
+struct foreground fg;
+struct workerPool pool;
+
+enum LAUNCHERS // how external commands are started, picked with -l at startup
+{
+	LAUNCH_FORK = 0,
+	LAUNCH_SPAWN
+};
+
+int launcher = LAUNCH_SPAWN;
+
+#define JOB_OUTPUT_SIZE 65536 // bytes of a background job's output kept with -b
+int jobOutput = -1; // with -b, epoll set of the pipes background jobs write to
+
+#define INPUT_BLOCK_SIZE 65536
+
+struct input { // batch mode input, read in large blocks instead of through readline
+	int fd;
+	char *buf;
+	size_t size; // bytes allocated for buf
+	size_t start; // first byte not yet returned as a line
+	size_t end; // one past the last byte read
+	int eof;
+};
+
+struct input input;
+parseArena lineArena; // holds the parse result of the current command line
 
 /* -----------------------------------------------------------------------------
-FUNCTION: buildPrompt()
-DESCRIPTION:
+FUNCTION: int openScratchFile(const char *name)
+DESCRIPTION: an anonymous memfd called name, so that no temporary file is
+created, or an unnamed O_TMPFILE file where memfd_create() is not available.
+The descriptor is close-on-exec. Returns -1 on failure.
 -------------------------------------------------------------------------------*/
-char *buildPrompt() {
-	char * prompt = (char * ) malloc(PATH_MAX);
-	char cwd[PATH_MAX];
-	if (getcwd(cwd, sizeof(cwd)) != NULL) {
-		strcpy(prompt, "{yosh}:");
-		strcat(prompt, cwd);
-		strcat(prompt, "$ ");
-		return prompt;
-	} else {
-		perror("getcwd() error");
-		exit(1);
+int openScratchFile(const char *name) {
+	int fd = memfd_create(name, MFD_CLOEXEC);
+
+	if (fd == -1) {
+		const char *dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+		fd = open(dir, O_TMPFILE|O_RDWR|O_CLOEXEC, 0600);
 	}
-	
-	
-	return prompt;
+	return fd;
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION: redirectionTester(parseInfo *info)
-DESCRIPTION: returns a new input file descriptor for input redirection or 0
-if there is either valid input or output redirection or no redirection taking
-place. This will return 0 if there is no input redirection. 
+FUNCTION: int openHereDocument(struct redirect *r)
+DESCRIPTION: puts the text of a here-string or here-document into a scratch
+file, and keeps its descriptor in r->target for the stage to dup2 like any
+other descriptor. The descriptor is positioned at the start. Returns -1 on
+failure.
 -------------------------------------------------------------------------------*/
-int redirectionTester(parseInfo *info) {
-	wordexp_t p;
-	int potentialInput = 0;
-	if (info->boolInfile) {
-		if (info->boolInfile > 1) {
-			fprintf(stderr, "Ambiguous input redirect.\n");
-			return -1;
+int openHereDocument(struct redirect *r) {
+	const char *text = r->type == REDIR_HEREDOC ? r->body : r->word;
+	size_t len = strlen(text);
+	int fd = openScratchFile("yosh-heredoc");
+
+	if (fd == -1) {
+		perror("here-document");
+		return -1;
+	}
+	if (fd_write(fd, text, len) == -1 ||
+			(r->type == REDIR_HERESTRING && fd_write(fd, "\n", 1) == -1)) { // a here-string ends in a newline
+		perror("here-document");
+		close(fd);
+		return -1;
+	}
+	lseek(fd, 0, SEEK_SET);
+	r->target = fd;
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: closeHereDocuments(parseInfo *info)
+DESCRIPTION: closes the shell's descriptors of the here-documents and
+here-strings of every stage of info, once the stages have their copies.
+-------------------------------------------------------------------------------*/
+void closeHereDocuments(parseInfo *info) {
+	struct redirect *r;
+	int i;
+
+	for (i = 0; i <= info->pipeNum; i++) {
+		for (r = info->CommArray[i].redirs; r != NULL; r = r->next) {
+			if ((r->type == REDIR_HEREDOC || r->type == REDIR_HERESTRING) && r->target != -1) {
+				close(r->target);
+				r->target = -1;
+			}
 		}
-		if (info->inFile[0] != '\0') {
-			if (strstr(info->inFile, "~")) {
-				wordexp(info->inFile, &p, 0);
-				strcpy(info->inFile, p.we_wordv[0]);
-				wordfree(&p);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int openHereDocuments(parseInfo *info)
+DESCRIPTION: opens the here-documents and here-strings of every stage of info
+with openHereDocument(). Returns -1, with none of them left open, on failure.
+-------------------------------------------------------------------------------*/
+int openHereDocuments(parseInfo *info) {
+	struct redirect *r;
+	int i;
+
+	for (i = 0; i <= info->pipeNum; i++) {
+		for (r = info->CommArray[i].redirs; r != NULL; r = r->next) {
+			if ((r->type == REDIR_HEREDOC || r->type == REDIR_HERESTRING) &&
+					openHereDocument(r) == -1) {
+				closeHereDocuments(info);
+				return -1;
 			}
-			if( access(info->inFile, F_OK ) != -1 ) {
-				int fd = open(info->inFile, O_RDONLY, 0644);
-				if (fd == -1) {
-					perror("open");
-					return -1;
-				}
-				dup2(fd, 0);
-				potentialInput = fd;
-				
-			} else {
-				fprintf(stderr, "%s: No such file or directory.\n", info->inFile);
+		}
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int applyRedirection(struct redirect *r)
+DESCRIPTION: makes r->fd what the redirection says, in the calling process: a
+file opened for reading, truncated, or appended to, a copy of another
+descriptor or of an opened here-document, or closed. > truncates a file that
+exists. Returns -1 after printing why it failed.
+-------------------------------------------------------------------------------*/
+int applyRedirection(struct redirect *r) {
+	int fd, flags;
+
+	switch (r->type) {
+	case REDIR_CLOSE:
+		close(r->fd);
+		return 0;
+	case REDIR_DUP:
+	case REDIR_HEREDOC:
+	case REDIR_HERESTRING:
+		if (r->target == r->fd) { // dup2() would leave it close-on-exec
+			if (fcntl(r->fd, F_SETFD, 0) == -1) {
+				fprintf(stderr, "%d: Bad file descriptor.\n", r->fd);
 				return -1;
 			}
-		} else {
-			fprintf(stderr, "Missing name for redirect.\n");
+			return 0;
+		}
+		if (dup2(r->target, r->fd) == -1) {
+			fprintf(stderr, "%d: Bad file descriptor.\n", r->target);
 			return -1;
 		}
+		return 0;
+	}
+
+	flags = r->type == REDIR_IN ? O_RDONLY :
+		r->type == REDIR_APPEND ? O_WRONLY|O_CREAT|O_APPEND : O_WRONLY|O_CREAT|O_TRUNC;
+	fd = open(r->word, flags|O_CLOEXEC, 0666);
+	if (fd == -1) {
+		perror(r->word);
+		return -1;
 	}
-	if (info->boolOutfile) {
-		if (info->boolOutfile > 1) {
-			fprintf(stderr, "Ambiguous output redirect.\n");
+	if (fd != r->fd) {
+		if (dup2(fd, r->fd) == -1) {
+			perror(r->word);
+			close(fd);
 			return -1;
 		}
-		if (info->outFile[0] != '\0') {
-			if (strstr(info->outFile, "~")) {
-				wordexp(info->outFile, &p, 0);
-				strcpy(info->outFile, p.we_wordv[0]);
-				wordfree(&p);
-			}
-			if( access(info->outFile, F_OK ) == -1 ) {
-				int fd = open(info->outFile, O_RDWR|O_CREAT|O_APPEND, 0644);
-				if (fd == -1) {
-					perror("open");
-					return -1;
-				}
-				dup2(fd, 1);
-			} else {
-				fprintf(stderr, "%s: File exists.\n", info->outFile);
-				return -1;
-			}
-		} else {
-			fprintf(stderr, "Missing name for redirect.\n");
+		close(fd);
+	} else {
+		fcntl(fd, F_SETFD, 0);
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int applyRedirections(struct redirect *r)
+DESCRIPTION: applies the redirections of a stage in the order they were
+written, in a forked stage right before it runs. Returns -1 if one failed.
+-------------------------------------------------------------------------------*/
+int applyRedirections(struct redirect *r) {
+	for (; r != NULL; r = r->next) {
+		if (applyRedirection(r) == -1) {
 			return -1;
 		}
 	}
-	return potentialInput;
+	return 0;
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION: jobID(int getID)
-DESCRIPTION: returns a job based on it's numerical ID. This assumes there exists
-a job with an ID of the parameter getID. This returns the job with the ID of said
-integer paramter, and returns NULL if that is not found before the loop 
-terminates by reaching NULL through assigning temp to its own nextjob.
+FUNCTION: restoreRedirections(struct redirect *redirs, int *saved)
+DESCRIPTION: puts back the descriptors that the redirections replaced, the last
+one first, from the copies kept by redirectBuiltin(). Those that were not
+applied have a saved copy of -2.
 -------------------------------------------------------------------------------*/
-struct job *jobID(int getID) {
-	struct job *temp = (struct job*) malloc(sizeof(struct job)); // creates a temporary object to loop until the ID is found
-	for (temp = head; temp != NULL; temp = temp->nextjob) {
-		if (getID == temp->num) {
-			return temp;
+void restoreRedirections(struct redirect *redirs, int *saved) {
+	struct redirect **list;
+	struct redirect *r;
+	int i, n = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+	for (r = redirs; r != NULL; r = r->next) {
+		n++;
+	}
+	list = arena_alloc(&lineArena, n * sizeof(struct redirect *));
+	if (list == NULL) {
+		return;
+	}
+	for (i = 0, r = redirs; r != NULL; i++, r = r->next) {
+		list[i] = r;
+	}
+	for (i = n - 1; i >= 0; i--) {
+		if (saved[i] == -2) {
+			continue;
+		} else if (saved[i] != -1) {
+			dup2(saved[i], list[i]->fd);
+			close(saved[i]);
+		} else {
+			close(list[i]->fd);
 		}
 	}
-	return NULL;
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION: isBuild()
-DESCRIPTION:
+FUNCTION: int *redirectBuiltin(struct redirect *redirs)
+DESCRIPTION: applies the redirections of a builtin that runs inside the shell,
+keeping close-on-exec copies of the descriptors they replace. Returns the
+copies to hand to restoreRedirections(), or NULL if a redirection failed, in
+which case the ones already applied have been undone.
 -------------------------------------------------------------------------------*/
-int isBuiltInCommand(char *cmd)
-{
-	if (strncmp(cmd, "exit", strlen("exit")) == 0) {
-		return EXIT;
+int *redirectBuiltin(struct redirect *redirs) {
+	struct redirect *r;
+	int n = 0, i;
+	int *saved;
+
+	for (r = redirs; r != NULL; r = r->next) {
+		n++;
 	}
-	if (strncmp(cmd, "history", strlen("history")) == 0) {
-		return HISTORY;
+	saved = arena_alloc(&lineArena, n * sizeof(int));
+	if (saved == NULL) {
+		return NULL;
 	}
-	if (strncmp(cmd, "cd", strlen("cd")) == 0) {
-		return CD;
+	for (i = 0; i < n; i++) {
+		saved[i] = -2;
 	}
-	if (strncmp(cmd, "help", strlen("help")) == 0) {
-		return HELP;
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0, r = redirs; r != NULL; r = r->next, i++) {
+		saved[i] = fcntl(r->fd, F_DUPFD_CLOEXEC, 10); // -1 if it was not open
+		if (applyRedirection(r) == -1) {
+			restoreRedirections(redirs, saved);
+			return NULL;
+		}
 	}
-	if (strncmp(cmd, "jobs", strlen("jobs")) == 0) {
-		return JOBS;
+	return saved;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: addRedirections(posix_spawn_file_actions_t *actions, struct redirect *r)
+DESCRIPTION: the spawn file actions that apply the redirections of a stage in
+the new process, in the order they were written, right before it execs.
+-------------------------------------------------------------------------------*/
+void addRedirections(posix_spawn_file_actions_t *actions, struct redirect *r) {
+	for (; r != NULL; r = r->next) {
+		switch (r->type) {
+		case REDIR_CLOSE:
+			posix_spawn_file_actions_addclose(actions, r->fd);
+			break;
+		case REDIR_IN:
+			posix_spawn_file_actions_addopen(actions, r->fd, r->word, O_RDONLY, 0666);
+			break;
+		case REDIR_OUT:
+			posix_spawn_file_actions_addopen(actions, r->fd, r->word, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+			break;
+		case REDIR_APPEND:
+			posix_spawn_file_actions_addopen(actions, r->fd, r->word, O_WRONLY|O_CREAT|O_APPEND, 0666);
+			break;
+		default: // a copy of a descriptor, or of an opened here-document
+			posix_spawn_file_actions_adddup2(actions, r->target, r->fd);
+			break;
+		}
 	}
-	if (strncmp(cmd, "kill", strlen("kill")) == 0) {
-		return KILL;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int exitCode(int status)
+DESCRIPTION: the exit status a wait status stands for in the shell: the code
+the process exited with, or 128 plus the signal that killed it
+-------------------------------------------------------------------------------*/
+int exitCode(int status) {
+	if (WIFSIGNALED(status)) {
+		return 128 + WTERMSIG(status);
 	}
-	return NO_SUCH_BUILTIN;
+	return WEXITSTATUS(status);
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION:int executeBuiltInCommand(char *command, char **argv) {
-DESCRIPTION:
+FUNCTION: reapChildren()
+DESCRIPTION: reaps every child that has exited with wait4, queueing its pid,
+status and resource usage in childEvents. Stops early when the ring is full;
+the remaining children stay zombies until drainChildEvents() makes room and
+calls this again. Only runs with SIGCHLD blocked or from its handler.
 -------------------------------------------------------------------------------*/
-int executeBuiltInCommand(char *command, char ** argv, int out) {
-	if (isBuiltInCommand(command) == HISTORY) { // the history command
-		
-		int count = 0, start = 0;
-		while(argv[++count] != NULL);
-		if (count == 3) {
-			if (strcmp(argv[1],"-s") == 0) {
-				int buffsize = atoi(argv[2]);
-				if (buffsize < 1) {
-					fprintf (stderr, "History buffer must be an integer of at least 1\n");
-				} else {
-					modHistory = buffsize;
-				}
-			} else {
-				fprintf (stderr, "history %s: Unknown arguments for history: %s\n", argv[1], argv[1]);
-			}
-			if (out != 0) { // breaks out if pipes are involved
-				exit(0); // exits and kills the child process
-			}
-			return 0;
-		} else if (count == 2) {
-			start = -1;
-			
-		}
-
-		register HIST_ENTRY ** hist_list;
-		register int i;
-		time_t tt;
-		FILE* fp; // only useful when built-in commands are being piped
-		char timestr[128];
-
-		hist_list = history_list();
-		if (hist_list) {
-			if (out != 0)
-				fp = fdopen(out, "w"); // creates a file stream if a pipe exists and history is to redirect it's own output
-			
-			if (start == -1) {
-				int j = 0;
-				for (i = 0; hist_list[i]; i++) { 
-					j++;
-				}
-				start = j - atoi(argv[1]);
-				if (start < 0) {
-					start = 0;
-				}
-			}
+void reapChildren() {
+	int saved = errno;
+	while ((eventHead + 1) % CHILD_EVENT_MAX != eventTail) {
+		struct childEvent *ev = &childEvents[eventHead];
+		ev->pid = wait4(-1, &ev->status, WNOHANG, &ev->usage);
+		if (ev->pid <= 0) {
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ev->when);
+		stat_count(STAT_REAPED);
+		eventHead = (eventHead + 1) % CHILD_EVENT_MAX;
+	}
+	errno = saved;
+}
 
-			for (i = start; hist_list[i]; i++) {
-				tt = history_get_time (hist_list[i]);
+/* -----------------------------------------------------------------------------
+FUNCTION: handle_sigchld(int s)
+DESCRIPTION: queues the exit of every child that ended, since a single signal
+may stand for several of them, and wakes up anything polling selfPipe. The
+events are applied to the job table and the foreground pipeline later, by
+drainChildEvents(), outside of the handler.
+-------------------------------------------------------------------------------*/
+void handle_sigchld( int s )
+{
+	int saved = errno;
+	reapChildren();
+	if (write(selfPipe[1], "", 1) == -1) {
+		// the pipe is full, which already means there is something to drain
+	}
+	errno = saved;
+}
 
-				if (tt)
-					strftime (timestr, sizeof (timestr), "%a %R", localtime(&tt));
-				else
-					strcpy (timestr, "??");
+/* -----------------------------------------------------------------------------
+FUNCTION: unsigned pidSlot(pid_t pid)
+DESCRIPTION: the home slot of pid in pidIndex; multiplying by the golden ratio
+spreads the mostly consecutive pids the kernel hands out over the table.
+-------------------------------------------------------------------------------*/
+unsigned pidSlot(pid_t pid) {
+	return ((unsigned) pid * 2654435761u) & (jobTable.pidCap - 1);
+}
 
-				if (out != 0) { // occurs if the intended output is not standard output
-					fprintf (fp, "%.4d: %s: %s\n", i + history_base, timestr, hist_list[i]->line);
-				} else { // occurs when the intended output is standard output
-					printf ("%.4d: %s: %s\n", i + history_base, timestr, hist_list[i]->line);
-				}
-			}
-			if (out != 0) { // breaks out if pipes are involved
-				exit(0);
-			}
-			return 0;
-		}
-	} else if (isBuiltInCommand(command) == CD) { // the cd command
-		int count = 0; 
-		while(argv[++count] != NULL);
-		if (count < 2) {
-			fprintf (stderr, "Usage: CD destination\n");
-			if (out != 0) { // breaks out if pipes are involved
-				exit(0); // exits and kills the child process
-			}
-			return 0;
-		}
-		wordexp_t result;
-		char * loc = argv[1];
-		
-		if (loc == NULL) {
-			loc = "~";
+/* -----------------------------------------------------------------------------
+FUNCTION: struct job *jobByPid(pid_t pid)
+DESCRIPTION: returns the job that pid is a stage of, or NULL. One probe of the
+pid index in the common case.
+-------------------------------------------------------------------------------*/
+struct job *jobByPid(pid_t pid) {
+	unsigned i;
+	if (jobTable.pidCap == 0) {
+		return NULL;
+	}
+	for (i = pidSlot(pid); jobTable.pidIndex[i].pid != 0; i = (i + 1) & (jobTable.pidCap - 1)) {
+		if (jobTable.pidIndex[i].pid == pid) {
+			return &jobTable.slots[jobTable.pidIndex[i].slot];
 		}
-		wordexp(loc, &result, 0);
-		char ** words = result.we_wordv;
-		chdir(words[0]);
-		wordfree(&result);
-		
-		return 0;
+	}
+	return NULL;
+}
 
-	} else if (isBuiltInCommand(command) == HELP) { // the help command
-		if (out != 0) {
-			FILE* fp; // only useful when built-in commands are being piped
-			fp = fdopen(out, "w"); // creates a file stream if a pipe exists and help is to redirect it's own output
-			fprintf (fp, "jobs\t\t\t\t\t\t\t\ttDisplays a list of background jobs\n");
-			fprintf (fp, "cd [directory name]\t\t\t\t\t\tMoves into a [directory name], if it exists\n");
-			fprintf (fp, "history [OPTIONAL -s num or OPTIONAL num]\t\t\tdisplays the command history. -s num sets the history buffer. num lists num elements\n");
-			fprintf (fp, "exit\t\t\t\t\t\t\t\texits out if there are no background commands running\n");
-			fprintf (fp, "kill [num or %%num]\t\t\t\t\t\tkills the process with pid num or job %%num\n");
-			fprintf (fp, "help\t\t\t\t\t\t\t\tthis! displays a list of commands\n");
-			exit(0); // breaks out if pipes are involved
-		}
-		printf("jobs\t\t\t\t\t\t\t\tDisplays a list of background jobs\n");
-		printf("cd [directory name]\t\t\t\t\t\tMoves into a [directory name], if it exists\n");
-		printf("history [OPTIONAL -s num or OPTIONAL num]\t\t\tdisplays the command history. -s num sets the history buffer. num lists num elements\n");
-		printf("exit\t\t\t\t\t\t\t\texits out if there are no background commands running\n");
-		printf("kill [num or %%num]\t\t\t\t\t\tkills the process with pid num or job %%num\n");
-		printf("help\t\t\t\t\t\t\t\tthis! displays a list of commands\n");
-		return 0;
-	} else if (isBuiltInCommand(command) == JOBS) { // the jobs command
-		if (head != NULL) {
-			FILE* fp; // only useful when built-in commands are being piped
-			if (out != 0) {
-				fp = fdopen(out, "w"); // creates a file stream if a pipe exists and help is to redirect it's own output
-			}
-			char *mode = (char *) malloc(sizeof(char) * 11);
-			struct job *jobstruct = (struct job*) malloc(sizeof(struct job));
-			int i = 1;
-			for (jobstruct = head; jobstruct != NULL; jobstruct = jobstruct->nextjob) {
-				if (jobstruct->mode == 3) {
-					if (jobstruct != head) {
-						if (jobstruct->nextjob != NULL) {
-							jobID(i - 1)->nextjob = jobstruct->nextjob;
-						} else {
-							jobID(i - 1)->nextjob = NULL;
-							free(jobstruct);
-						}
-					} else { // when the current job is equal to head
-						if (jobstruct->nextjob != NULL) {
-							head = jobstruct->nextjob;
-							free(jobstruct);
-						} else {
-							free(jobstruct);
-							head = NULL;
-							break;
-						}
-					}
-					continue;
-				}
-				else if (jobstruct->mode == 2) {
-					strcpy(mode, "Terminated");
-					jobstruct->mode = 3;
-				} else {
-					if (kill(jobstruct->pid, 0) == 0) {
-						strcpy(mode, "Running");
-					}
-					else {
-						strcpy(mode, "Done");
-						jobstruct->mode = 3;
-					}
-				}
-				jobstruct->num = i; // sets the id of jobstruct
-				i++; // incriments here to prevent cleared jobs from interfering
-				//free(jobstruct);
-				if (out != 0) { // breaks out if pipes are involved
-					fprintf (fp, "[%d]\t%d\t%s\t%s\n", jobstruct->num, jobstruct->pid, mode, jobstruct->command);
-				} else {
-					printf("[%d]\t%d\t%s\t%s\n", jobstruct->num, jobstruct->pid, mode, jobstruct->command);
-				}
-			}
-		}
-		if (out != 0) { // breaks out if pipes are involved
-			exit(0); // exits and kills the child process
-		}
-		return 0;
-	} else if (isBuiltInCommand(command) == KILL) { // the kill command
-		int count = 0; 
-		while(argv[++count] != NULL);
-		if (count < 2) {
-			fprintf (stderr, "Usage: Kill %%number\n");
-			if (out != 0) { // breaks out if pipes are involved
-				exit(0); // exits and kills the child process
+/* -----------------------------------------------------------------------------
+FUNCTION: jobID(int getID)
+DESCRIPTION: returns the job with the number getID, or NULL if there is none.
+A job's number is its slot in the job table plus one, so this is an index.
+-------------------------------------------------------------------------------*/
+struct job *jobID(int getID) {
+	if (getID < 1 || getID > jobTable.used || jobTable.slots[getID - 1].num == 0) {
+		return NULL;
+	}
+	return &jobTable.slots[getID - 1];
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: indexPid(pid_t pid, int slot)
+DESCRIPTION: makes pid point at the job in slot. A pid the kernel reused while
+the job it used to belong to is still listed now points at the newer job.
+The index is kept at most half full.
+-------------------------------------------------------------------------------*/
+void indexPid(pid_t pid, int slot) {
+	unsigned i;
+	if ((jobTable.pidCount + 1) * 2 > jobTable.pidCap) {
+		struct pidEntry *old = jobTable.pidIndex;
+		int oldCap = jobTable.pidCap, j;
+		jobTable.pidCap = oldCap ? oldCap * 2 : 64;
+		jobTable.pidIndex = (struct pidEntry *) stat_alloc(calloc(jobTable.pidCap, sizeof(struct pidEntry)));
+		for (j = 0; j < oldCap; j++) {
+			if (old[j].pid != 0) {
+				for (i = pidSlot(old[j].pid); jobTable.pidIndex[i].pid != 0; i = (i + 1) & (jobTable.pidCap - 1));
+				jobTable.pidIndex[i] = old[j];
 			}
-			return 0;
 		}
-		if (strlen(argv[1]) < 1) {
-			fprintf (stderr, "Usage: Kill %%number\n");
-			if (out != 0) { // breaks out if pipes are involved
-				exit(0); // exits and kills the child process
-			}
-			return 0;
+		free(old);
+	}
+	for (i = pidSlot(pid); jobTable.pidIndex[i].pid != 0; i = (i + 1) & (jobTable.pidCap - 1)) {
+		if (jobTable.pidIndex[i].pid == pid) {
+			jobTable.pidIndex[i].slot = slot;
+			return;
 		}
-		struct job *tempjob = (struct job*) malloc(sizeof(struct job)); // tempjob for finding size
-		if (argv[1][0] == '%') {
-			int id = atoi(argv[1] + 1);
-			tempjob = jobID(id);
-		} else { 
-			int pid = atoi(argv[1]);
-			for (tempjob = head; tempjob != NULL; tempjob = tempjob->nextjob) {
-				if (pid == tempjob->pid) {
-					break;
-				}
-			}
+	}
+	jobTable.pidIndex[i].pid = pid;
+	jobTable.pidIndex[i].slot = slot;
+	jobTable.pidCount++;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: unindexPid(pid_t pid, int slot)
+DESCRIPTION: removes pid from the pid index if it still points at the job in
+slot. The entries after it are shifted back so that no probe sequence is cut
+short, the same way hash_remove() does it.
+-------------------------------------------------------------------------------*/
+void unindexPid(pid_t pid, int slot) {
+	unsigned mask = jobTable.pidCap - 1, i, j, home;
+	for (i = pidSlot(pid); jobTable.pidIndex[i].pid != pid; i = (i + 1) & mask) {
+		if (jobTable.pidIndex[i].pid == 0) {
+			return;
 		}
-		if (tempjob == NULL) {
-			fprintf (stderr, "yosh: kill: (%s) - No such process\n", argv[1]);
-		} else {
-			if (kill(tempjob->pid, SIGKILL) < 0) {
-				perror("kill");
-			} else {
-				tempjob->mode = 2;
-				if (out != 0) {
-					FILE* fp; // only useful when built-in commands are being piped
-					fp = fdopen(out, "w"); // creates a file stream if a pipe exists and help is to redirect it's own output
-					fprintf(fp, "Process killed: %d\n", tempjob->pid);
-				}
-				printf("Process killed: %d\n", tempjob->pid);
-			}
+	}
+	if (jobTable.pidIndex[i].slot != slot) {
+		return;
+	}
+	for (j = (i + 1) & mask; jobTable.pidIndex[j].pid != 0; j = (j + 1) & mask) {
+		home = pidSlot(jobTable.pidIndex[j].pid);
+		if (((j - home) & mask) >= ((j - i) & mask)) { // j may move back to i
+			jobTable.pidIndex[i] = jobTable.pidIndex[j];
+			i = j;
 		}
-		if (out != 0) { // breaks out if pipes are involved
-			exit(0); // exits and kills the child process
+	}
+	jobTable.pidIndex[i].pid = 0;
+	jobTable.pidCount--;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: struct job *addJob(char *command, pid_t *pids, int n)
+DESCRIPTION: puts a new running job in the job table, taking over command, a
+malloc'd string. pids are its n stages, a 0 standing for one that ran in the
+shell; a job with no forked stage at all is finished from the start. The job
+gets the most recently freed slot, and with it that slot's number, or a new
+one at the end; the number stays the same until the job is removed.
+-------------------------------------------------------------------------------*/
+struct job *addJob(char *command, pid_t *pids, int n) {
+	struct job *newjob;
+	int slot, i;
+
+	if (jobTable.freeList != -1) {
+		slot = jobTable.freeList;
+		jobTable.freeList = jobTable.slots[slot].nextFree;
+	} else {
+		if (jobTable.used == jobTable.cap) {
+			jobTable.cap = jobTable.cap ? jobTable.cap * 2 : 16;
+			jobTable.slots = (struct job *) stat_alloc(realloc(jobTable.slots, jobTable.cap * sizeof(struct job)));
 		}
-		return 0;
- 	} else if (isBuiltInCommand(command) == EXIT) { // the exit command
-	 	if (head != NULL) {
-			 struct job *jobstruct = (struct job*) malloc(sizeof(struct job));
-			for (jobstruct = head; jobstruct != NULL; jobstruct = jobstruct->nextjob) {
-				if (kill(jobstruct->pid, 0) == 0) {
-					if (out != 0) {
-						FILE* fp; // only useful when built-in commands are being piped
-						fp = fdopen(out, "w"); // creates a file stream if a pipe exists and help is to redirect it's own output
-						fprintf(fp, "There are still jobs running!\n");
-						return 0;
-					}
-					printf("There are still jobs running!\n");
-					return 0;
-				}
-			}
+		slot = jobTable.used++;
+	}
+	newjob = &jobTable.slots[slot];
+	memset(newjob, 0, sizeof(*newjob));
+	newjob->num = slot + 1;
+	newjob->command = command;
+	newjob->mode = JOB_RUNNING;
+	newjob->pids = (pid_t *) stat_alloc(malloc(n * sizeof(pid_t)));
+	for (i = 0; i < n; i++) {
+		if (pids[i] > 0) { // skips a builtin that ran in the shell
+			newjob->pids[newjob->stages++] = pids[i];
+			indexPid(pids[i], slot);
 		}
-		exit(0); // exits and kills the child process
 	}
-	return 0;
+	if (newjob->stages == 0) { // every stage ran in the shell, so it is over already
+		newjob->mode = JOB_FINISHED;
+	} else {
+		newjob->pid = newjob->pids[0];
+	}
+	newjob->stagesLeft = newjob->stages;
+	newjob->nextFree = -1;
+	newjob->outFd = -1;
+	jobTable.count++;
+	return newjob;
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION: void executeCommand(char *command, char **argv) {
-DESCRIPTION: The executeCommand is designed to differentiate built-in commands
-and external commands, and is called exclusively by the main method. The
-context in which it is called is the most important part of this command, as it
-is designed to only be called within the child process of a fork, therefore must
-terminate itself eventually. Therefore this command does not return anything,
-except when an error occurs with an external or built-in command. The char
-pointer command refers to the command in question, while the char pointer pointer
-refers to the arguements of the command.
+FUNCTION: closeJobOutput(struct job *jobstruct)
+DESCRIPTION: stops capturing the output of a job, taking its pipe out of the
+epoll set first: a forked builtin may still hold a copy of it, which would
+keep it there after close().
 -------------------------------------------------------------------------------*/
-int executeCommand(char *command, char **argv) {
-	if (isBuiltInCommand(command)) {
-		return executeBuiltInCommand(command, argv, 1);
+void closeJobOutput(struct job *jobstruct) {
+	if (jobstruct->outFd != -1) {
+		epoll_ctl(jobOutput, EPOLL_CTL_DEL, jobstruct->outFd, NULL);
+		close(jobstruct->outFd);
+		jobstruct->outFd = -1;
 	}
-	return execvp(command, argv);
 }
 
-void handle_sigchld( int s )
-{
-    /* execute non-blocking waitpid, loop because we may only receive
-     * a single signal if multiple processes exit around the same time.
-     */
-    while( waitpid(0, NULL, WNOHANG) > 0) ;
-}
-
-/* -----------------------------------------------------------------------------
-FUNCTION: int pipingHandler(char ** argv , int in, int out) {
-DESCRIPTION: Handles the creation of pipes that are designed to allow for
-input and output redirection of a potentially infinite number of commands tied
-together, the first of which is likely standard input and the last of which
-is likely standard output. The char pointer pointer argv is the command and all 
-its arguements. The integer in is a file pointer to the intended input. The
-integer out is a file pointer to the intended output. This method forks, and the
-child process terminates itself using the methods execvp or 
-executeBuiltInCommand. The parent returns the pid of the parent process.
--------------------------------------------------------------------------------*/
-int pipingHandler(char ** argv , int in, int out) {
-	int pid;
-	if ((pid = fork()) == 0) { // forks for piping
-		
-		if (in != 0) { // only occurs if the start of the pipe is standard input
-			dup2(in, STDIN_FILENO); // makes sure standard input is sent to fds[0] or the start of the pipe
-			close(in);
-		}
+/* -----------------------------------------------------------------------------
+FUNCTION: removeJob(struct job *jobstruct)
+DESCRIPTION: takes a job out of the job table, freeing what it owns, and puts
+its slot on the free list. Slots at the end of the table are given back
+instead, so that the numbers of new jobs start low again once the table
+empties.
+-------------------------------------------------------------------------------*/
+void removeJob(struct job *jobstruct) {
+	int slot = jobstruct->num - 1, i;
+
+	for (i = 0; i < jobstruct->stages; i++) {
+		unindexPid(jobstruct->pids[i], slot);
+	}
+	closeJobOutput(jobstruct);
+	free(jobstruct->command);
+	free(jobstruct->pids);
+	free(jobstruct->output);
+	jobstruct->command = NULL;
+	jobstruct->pids = NULL;
+	jobstruct->output = NULL;
+	jobstruct->num = 0;
+	jobTable.count--;
 
-		if (out != 1) { // occurs if the end of the pipe is standard output
-			dup2(out, STDOUT_FILENO); // makes sure standard output is sent to fds[1] or the end of the pipe
-			close(out);
+	if (slot == jobTable.used - 1) {
+		jobTable.used--;
+		while (jobTable.used > 0 && jobTable.slots[jobTable.used - 1].num == 0) {
+			jobTable.used--;
 		}
-		if (!isBuiltInCommand(argv[0])) {
-			return execvp(argv[0], argv); // runs execvp for non-built in commands
-		} else { // occurs when the command is not built in
-			return executeBuiltInCommand(argv[0], argv, 1);
+		// the free list may now name slots past the end, drop them
+		int *link = &jobTable.freeList;
+		while (*link != -1) {
+			if (*link >= jobTable.used) {
+				*link = jobTable.slots[*link].nextFree;
+			} else {
+				link = &jobTable.slots[*link].nextFree;
+			}
 		}
+	} else {
+		jobstruct->nextFree = jobTable.freeList;
+		jobTable.freeList = slot;
 	}
-	waitpid(pid, NULL, 0);
-	return pid;
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION: main()
-DESCRIPTION: the main command of the terminal -- initialization is contained
-within this command as well and argv should be empty and argc should be 1. There
-should be no command-line arguments for this shell.
+FUNCTION: watchJobOutput(struct job *jobstruct, int fd)
+DESCRIPTION: makes fd, the non-blocking read end of the pipe the stages of a
+background job write their output to, that job's, and adds it to the epoll set
+under the job's number. Without it the job would block once the pipe is full,
+so it is closed if epoll will not take it and the job gets SIGPIPE instead.
 -------------------------------------------------------------------------------*/
-int main(int argc, char **argv) {
-	parseInfo *info;		 // info stores all the information returned by parser.
-	struct commandType *com; // com stores command name and Arg list for one command.
-	
-	head = NULL;
-	
-	char *cmdLine;
-	pid_t childPid;
-	int status; // A pointer to the location where status information for the terminating process is to be stored
+void watchJobOutput(struct job *jobstruct, int fd) {
+	struct epoll_event ev;
 
-	int fds[2];
-	int new_desc;
-
-	fprintf(stdout, "This is the YOSH version 0.1\n");
+	ev.events = EPOLLIN;
+	ev.data.u32 = jobstruct->num;
+	if (epoll_ctl(jobOutput, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		perror("epoll_ctl");
+		close(fd);
+		return;
+	}
+	jobstruct->outFd = fd;
+}
 
-	signal(SIGCHLD, handle_sigchld);
+/* -----------------------------------------------------------------------------
+FUNCTION: readJobOutput(struct job *jobstruct)
+DESCRIPTION: moves what is waiting in the output pipe of a job into its ring,
+reading straight into the ring so that the oldest bytes are overwritten once it
+is full. Stops when the pipe is empty; at end of file, once every writer has
+gone, the pipe is closed.
+-------------------------------------------------------------------------------*/
+void readJobOutput(struct job *jobstruct) {
+	ssize_t n;
+	size_t room;
 
+	if (jobstruct->output == NULL &&
+			(jobstruct->output = (char *) stat_alloc(malloc(JOB_OUTPUT_SIZE))) == NULL) {
+		return; // stays readable, tried again next time
+	}
 	while (1) {
-		// insert your code here
-
-		cmdLine = readline(buildPrompt());
-		if (cmdLine == NULL) {
-			fprintf(stderr, "Unable to read command\n");
+		room = JOB_OUTPUT_SIZE - jobstruct->outHead; // up to the end of the ring
+		n = read(jobstruct->outFd, jobstruct->output + jobstruct->outHead, room);
+		if (n < 0 && errno == EINTR) {
 			continue;
 		}
-
-		// insert your code about history and !x !-x here
-		char *buffer;
-		using_history();
-		if (modHistory != 0) {
-			stifle_history(modHistory);
-		} else {
-			stifle_history(10);
+		if (n == 0) {
+			closeJobOutput(jobstruct);
 		}
-		int result = history_expand(cmdLine, &buffer);
-		add_history(buffer);
-		strncpy(cmdLine, buffer, sizeof(cmdLine) - 1);
-		
-		// calls the parser
-		info = parse(cmdLine);
-		if (info == NULL) {
-			free(cmdLine);
-			continue;
+		if (n <= 0) {
+			return;
 		}
+		jobstruct->outHead = (jobstruct->outHead + n) % JOB_OUTPUT_SIZE;
+		jobstruct->outLen += n;
+		if (jobstruct->outLen > JOB_OUTPUT_SIZE) {
+			jobstruct->outLen = JOB_OUTPUT_SIZE;
+		}
+		jobstruct->outTotal += n;
+		if ((size_t) n < room) {
+			return; // the pipe had no more
+		}
+	}
+}
 
-		if (result)
-	    	fprintf (stderr, "%s\n", buffer);
-
-		free(buffer);
-
+/* -----------------------------------------------------------------------------
+FUNCTION: pollJobOutput(int timeout, const sigset_t *mask)
+DESCRIPTION: waits up to timeout ms, -1 for ever, for background jobs to write
+output, with the signal mask set to mask meanwhile as epoll_pwait() does it,
+and reads it into their rings. A wait is cut short by a signal let through.
+-------------------------------------------------------------------------------*/
+void pollJobOutput(int timeout, const sigset_t *mask) {
+	struct epoll_event events[16];
+	struct job *jobstruct;
+	int n, i;
 
-		// prints the info struct
-		//print_info(info);
+	n = epoll_pwait(jobOutput, events, 16, timeout, mask);
+	for (i = 0; i < n; i++) {
+		jobstruct = jobID(events[i].data.u32);
+		if (jobstruct != NULL && jobstruct->outFd != -1) {
+			readJobOutput(jobstruct);
+		}
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: drainJobOutput()
+DESCRIPTION: reads whatever background jobs have written so far into their
+rings, without waiting. Does nothing without -b.
+-------------------------------------------------------------------------------*/
+void drainJobOutput() {
+	if (jobOutput != -1) {
+		pollJobOutput(0, NULL);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: retireJob(struct job *jobstruct)
+DESCRIPTION: forgets a finished job that has been reported, unless it left
+captured output that jobs -o has not shown yet: then it stays in the table,
+marked as reported, until it has.
+-------------------------------------------------------------------------------*/
+void retireJob(struct job *jobstruct) {
+	drainJobOutput();
+	if (jobstruct->outLen > 0) {
+		jobstruct->reported = 1;
+	} else {
+		removeJob(jobstruct);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: addUsage(struct rusage *sum, struct rusage *usage)
+DESCRIPTION: adds the times and counters of usage to sum; the max RSS of sum
+becomes the larger of the two.
+-------------------------------------------------------------------------------*/
+void addUsage(struct rusage *sum, struct rusage *usage) {
+	timeradd(&sum->ru_utime, &usage->ru_utime, &sum->ru_utime);
+	timeradd(&sum->ru_stime, &usage->ru_stime, &sum->ru_stime);
+	if (usage->ru_maxrss > sum->ru_maxrss) {
+		sum->ru_maxrss = usage->ru_maxrss;
+	}
+	sum->ru_minflt += usage->ru_minflt;
+	sum->ru_majflt += usage->ru_majflt;
+	sum->ru_nvcsw += usage->ru_nvcsw;
+	sum->ru_nivcsw += usage->ru_nivcsw;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: applyChildEvent(struct childEvent *ev)
+DESCRIPTION: records the exit of a child, either in the foreground pipeline
+being waited for, in the worker pool of parallel, or in the background job it
+belongs to. A job is finished when its last stage exits; the status of its
+final stage is its status.
+-------------------------------------------------------------------------------*/
+void applyChildEvent(struct childEvent *ev) {
+	struct job *jobstruct;
+	int i;
+
+	for (i = 0; i < pool.n; i++) {
+		if (pool.pids[i] == ev->pid) {
+			pool.statuses[i] = ev->status;
+			pool.exited++;
+			return;
+		}
+	}
+
+	for (i = 0; i < fg.n; i++) {
+		if (fg.pids[i] == ev->pid) {
+			fg.statuses[i] = ev->status;
+			if (fg.times != NULL) {
+				fg.times[i].usage = ev->usage;
+				fg.times[i].end = ev->when;
+			}
+			fg.left--;
+			return;
+		}
+	}
+
+	jobstruct = jobByPid(ev->pid);
+	if (jobstruct == NULL) { // a child of an earlier failed launch
+		return;
+	}
+	addUsage(&jobstruct->usage, &ev->usage);
+	if (jobstruct->pids[jobstruct->stages - 1] == ev->pid) {
+		jobstruct->status = ev->status;
+	}
+	if (--jobstruct->stagesLeft == 0) {
+		jobstruct->mode = JOB_FINISHED;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: drainChildEvents()
+DESCRIPTION: applies every child exit queued by handle_sigchld(). Safe to call
+whether or not SIGCHLD is blocked.
+-------------------------------------------------------------------------------*/
+void drainChildEvents() {
+	sigset_t saved;
+	char buf[64];
+
+	sigprocmask(SIG_BLOCK, &chldMask, &saved);
+	while (read(selfPipe[0], buf, sizeof(buf)) > 0);
+	do {
+		while (eventTail != eventHead) {
+			applyChildEvent(&childEvents[eventTail]);
+			eventTail = (eventTail + 1) % CHILD_EVENT_MAX;
+		}
+		reapChildren(); // picks up what did not fit in the ring
+	} while (eventTail != eventHead);
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: waitForChildren(int (*done)(void *), void *arg)
+DESCRIPTION: sleeps until done(arg) is true, applying child exits as they
+come in. SIGCHLD is only let through inside sigsuspend, so an exit can never
+slip in between the test and going to sleep. With -b it sleeps in
+epoll_pwait() instead, with the same mask, and reads the output of background
+jobs as it comes.
+-------------------------------------------------------------------------------*/
+void waitForChildren(int (*done)(void *), void *arg) {
+	sigset_t saved, waitMask;
+
+	sigprocmask(SIG_BLOCK, &chldMask, &saved);
+	waitMask = saved;
+	sigdelset(&waitMask, SIGCHLD);
+	while (1) {
+		siginfo_t child;
+		drainChildEvents();
+		if (done(arg)) {
+			break;
+		}
+		child.si_pid = 0;
+		if (waitid(P_ALL, 0, &child, WEXITED|WNOHANG|WNOWAIT) == -1) {
+			break; // no children at all, as in a builtin forked into a pipeline
+		}
+		if (child.si_pid != 0) {
+			continue; // an exit the full ring left unreaped, it drains next round
+		}
+		if (jobOutput != -1) { // background jobs are not left blocked on a full pipe
+			pollJobOutput(-1, &waitMask);
+		} else {
+			sigsuspend(&waitMask);
+		}
+	}
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int foregroundDone(void *unused)
+DESCRIPTION: waitForChildren() test for the end of the foreground pipeline
+-------------------------------------------------------------------------------*/
+int foregroundDone(void *unused) {
+	return fg.left == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: const char *historyTime(time_t tt)
+DESCRIPTION: formats the time a history entry was typed at. Entries come in
+runs typed within the same minute, so the last result is reused until the
+minute changes rather than calling localtime and strftime for every entry.
+-------------------------------------------------------------------------------*/
+const char *historyTime(time_t tt) {
+	static char timestr[128] = "??";
+	static time_t minute = -1;
+
+	if (tt == 0) {
+		return "??";
+	}
+	if (tt / 60 != minute) {
+		minute = tt / 60;
+		strftime (timestr, sizeof (timestr), "%a %R", localtime(&tt));
+	}
+	return timestr;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: printHistory(FILE *out, long start, long end)
+DESCRIPTION: lists the entries start up to end of the history file, numbered
+from 1
+-------------------------------------------------------------------------------*/
+void printHistory(FILE *out, long start, long end) {
+	const char *line;
+	size_t len;
+	time_t tt;
+	long i;
+
+	for (i = start < 0 ? 0 : start; i < end; i++) {
+		line = hist_entry(i, &len, &tt);
+		if (line != NULL) {
+			fprintf (out, "%.4ld: %s: %.*s\n", i + 1, historyTime(tt), (int) len, line);
+		}
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: printReadlineHistory(FILE *out, int last)
+DESCRIPTION: lists the last entries of the readline history, for when there is
+no history file
+-------------------------------------------------------------------------------*/
+void printReadlineHistory(FILE *out, int last) {
+	HIST_ENTRY **hist_list = history_list();
+	int i, start;
+
+	if (hist_list == NULL) {
+		return;
+	}
+	for (i = 0; hist_list[i]; i++);
+	start = i - last < 0 ? 0 : i - last;
+	for (i = start; hist_list[i]; i++) {
+		fprintf (out, "%.4d: %s: %s\n", i + history_base,
+			historyTime(history_get_time(hist_list[i])), hist_list[i]->line);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinHistory(char **argv, FILE *out)
+DESCRIPTION: the history command. "history" lists the last entries, as many as
+the history buffer holds, "history num" lists the last num entries and
+"history -s num" sets the size of the history buffer. "history -g pattern"
+lists every entry that contains pattern. The entries come from the history
+file, which keeps every line ever typed; the last ones are found through its
+index without reading the rest.
+-------------------------------------------------------------------------------*/
+int builtinHistory(char **argv, FILE *out) {
+	int count = 0, last = modHistory ? modHistory : HISTORY_DEFAULT_SIZE;
+	long i;
+	while(argv[++count] != NULL);
+	if (count == 3) {
+		if (strcmp(argv[1],"-s") == 0) {
+			int buffsize = atoi(argv[2]);
+			if (buffsize < 1) {
+				fprintf (stderr, "History buffer must be an integer of at least 1\n");
+				return 1;
+			} else {
+				modHistory = buffsize;
+				stifle_history(modHistory);
+			}
+		} else if (strcmp(argv[1],"-g") == 0) {
+			if (!hist_is_open()) {
+				fprintf (stderr, "history: -g: there is no history file\n");
+				return 1;
+			}
+			for (i = hist_search(argv[2], 0); i != -1; i = hist_search(argv[2], i + 1)) {
+				printHistory(out, i, i + 1);
+			}
+		} else {
+			fprintf (stderr, "history %s: Unknown arguments for history: %s\n", argv[1], argv[1]);
+			return 1;
+		}
+		return 0;
+	} else if (count == 2) {
+		last = atoi(argv[1]);
+	}
+
+	if (hist_is_open()) {
+		long end = hist_count();
+		printHistory(out, end - last, end);
+	} else {
+		printReadlineHistory(out, last);
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: loadHistory()
+DESCRIPTION: adds the entries of the history file that readline has not seen
+yet to the readline history. Only the last ones that fit in the history buffer
+are read, and readline numbers them as they are numbered in the file, so that
+!num means the same line as in the history command.
+-------------------------------------------------------------------------------*/
+void loadHistory() {
+	const char *line;
+	size_t len;
+	long i, start, end = hist_count();
+	int size = modHistory ? modHistory : HISTORY_DEFAULT_SIZE;
+
+	if (end <= historySeen) {
+		return;
+	}
+	start = end - size > historySeen ? end - size : historySeen;
+	for (i = start; i < end; i++) {
+		line = hist_entry(i, &len, NULL);
+		if (line != NULL) {
+			char *copy = stat_alloc(strndup(line, len));
+			add_history(copy);
+			free(copy);
+		}
+	}
+	historySeen = end;
+	history_base = end - history_length + 1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: openHistory()
+DESCRIPTION: opens the history file, $YOSH_HISTFILE or HIST_FILE_NAME in $HOME,
+and loads its last entries into readline for the arrow keys and !
+expansion. With $YOSH_SHARED_HISTORY set, the lines of the other shells
+using the same file are picked up before every prompt as well.
+-------------------------------------------------------------------------------*/
+void openHistory() {
+	char path[PATH_MAX];
+	const char *file = getenv("YOSH_HISTFILE");
+	const char *home = getenv("HOME");
+	const char *shared = getenv("YOSH_SHARED_HISTORY");
+
+	stifle_history(HISTORY_DEFAULT_SIZE);
+	if (file == NULL) {
+		if (home == NULL) {
+			return;
+		}
+		snprintf(path, sizeof(path), "%s/%s", home, HIST_FILE_NAME);
+		file = path;
+	}
+	if (hist_open(file) == -1) {
+		perror(file);
+		return;
+	}
+	sharedHistory = shared != NULL && *shared != '\0' && strcmp(shared, "0") != 0;
+	loadHistory();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinCd(char **argv, FILE *out)
+DESCRIPTION: the cd command, moves into the given directory
+-------------------------------------------------------------------------------*/
+int builtinCd(char **argv, FILE *out) {
+	int count = 0; 
+	while(argv[++count] != NULL);
+	if (count < 2) {
+		fprintf (stderr, "Usage: CD destination\n");
+		return 1;
+	}
+	if (chdir(argv[1]) == -1) { // ~ was expanded with the other words
+		perror("cd");
+		return 1;
+	}
+	prompt_cwd_changed();
+	
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinHelp(char **argv, FILE *out)
+DESCRIPTION: the help command, displays a list of commands
+-------------------------------------------------------------------------------*/
+int builtinHelp(char **argv, FILE *out) {
+	fprintf(out, "jobs [-o %%num]\t\t\t\t\t\t\tDisplays a list of background jobs, -o the output captured from job %%num with yosh -b\n");
+	fprintf(out, "cd [directory name]\t\t\t\t\t\tMoves into a [directory name], if it exists\n");
+	fprintf(out, "history [OPTIONAL -s num or -g pattern or num]\t\tdisplays the command history. -s num sets the history buffer. -g lists the entries containing pattern. num lists num elements\n");
+	fprintf(out, "exit\t\t\t\t\t\t\t\texits out if there are no background commands running\n");
+	fprintf(out, "kill [num or %%num]\t\t\t\t\t\tkills the process with pid num or job %%num\n");
+	fprintf(out, "hash [-r] [name ...]\t\t\t\t\tlists the remembered command paths, -r forgets them, names are looked up\n");
+	fprintf(out, "wait [%%num or num]\t\t\t\t\t\twaits for job %%num or the job with pid num, or for every job\n");
+	fprintf(out, "time [-p or -j] pipeline\t\t\t\t\truns pipeline and reports its times, memory, faults and context switches\n");
+	fprintf(out, "yoshstat [-j] [-r]\t\t\t\t\t\tshows what the shell spent its time on, -j as JSON, -r then resets it\n");
+	fprintf(out, "parallel [-j N] [-k] command [{}] [::: args]\t\t\truns command once per argument, or per line of input, N at a time; -k keeps the order\n");
+	fprintf(out, "ycat [file ...]\t\t\t\t\t\t\tcopies the files, or standard input, to standard output inside the kernel\n");
+	fprintf(out, "help\t\t\t\t\t\t\t\tthis! displays a list of commands\n");
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: const char *jobState(struct job *jobstruct, char *buf, size_t size)
+DESCRIPTION: describes how far a job has got, from the status recorded when its
+stages exited: "Running", "Done", "Exit N" or the name of the signal that
+killed it. buf is only used for "Exit N".
+-------------------------------------------------------------------------------*/
+const char *jobState(struct job *jobstruct, char *buf, size_t size) {
+	if (jobstruct->mode == JOB_RUNNING) {
+		return "Running";
+	}
+	if (WIFSIGNALED(jobstruct->status)) {
+		return strsignal(WTERMSIG(jobstruct->status));
+	}
+	if (WEXITSTATUS(jobstruct->status) != 0) {
+		snprintf(buf, size, "Exit %d", WEXITSTATUS(jobstruct->status));
+		return buf;
+	}
+	return "Done";
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: struct job *jobByArgument(const char *arg)
+DESCRIPTION: finds the job named by a builtin argument, either %num for a job
+id or the pid of one of its stages. Returns NULL if there is none.
+-------------------------------------------------------------------------------*/
+struct job *jobByArgument(const char *arg) {
+	if (arg[0] == '%') {
+		return jobID(atoi(arg + 1));
+	}
+	return jobByPid(atoi(arg));
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: notifyJobs()
+DESCRIPTION: tells the user about the background jobs that finished since the
+last prompt, the way jobs would show them, and removes them, except those whose
+captured output is yet to be shown
+-------------------------------------------------------------------------------*/
+void notifyJobs() {
+	struct job *jobstruct;
+	char buf[32];
+	int i;
+	for (i = 0; i < jobTable.used; i++) {
+		jobstruct = &jobTable.slots[i];
+		if (jobstruct->num != 0 && jobstruct->mode == JOB_FINISHED && !jobstruct->reported) {
+			printf("[%d]\t%d\t%s\t%s\n", jobstruct->num, jobstruct->pid,
+				jobState(jobstruct, buf, sizeof(buf)), jobstruct->command);
+			retireJob(jobstruct);
+		}
+	}
+	fflush(stdout);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int showJobOutput(const char *arg, FILE *out)
+DESCRIPTION: jobs -o, writes the output captured from the job named by arg to
+out, oldest byte first, and forgets the job if it has finished.
+-------------------------------------------------------------------------------*/
+int showJobOutput(const char *arg, FILE *out) {
+	struct job *jobstruct;
+	size_t start, first;
+
+	if (jobOutput == -1) {
+		fprintf(stderr, "yosh: jobs: -o: output is only captured when yosh is started with -b\n");
+		return 1;
+	}
+	drainJobOutput();
+	jobstruct = jobByArgument(arg);
+	if (jobstruct == NULL) {
+		fprintf(stderr, "yosh: jobs: %s: no such job\n", arg);
+		return 1;
+	}
+	if (jobstruct->outTotal > jobstruct->outLen) {
+		fprintf(stderr, "yosh: jobs: [%d]: only the last %zu of %lu bytes were kept\n",
+			jobstruct->num, jobstruct->outLen, jobstruct->outTotal);
+	}
+	start = (jobstruct->outHead + JOB_OUTPUT_SIZE - jobstruct->outLen) % JOB_OUTPUT_SIZE;
+	first = jobstruct->outLen;
+	if (first > JOB_OUTPUT_SIZE - start) { // the ring wraps
+		first = JOB_OUTPUT_SIZE - start;
+	}
+	if (jobstruct->outLen > 0) {
+		fwrite(jobstruct->output + start, 1, first, out);
+		fwrite(jobstruct->output, 1, jobstruct->outLen - first, out);
+	}
+	if (jobstruct->mode == JOB_FINISHED) {
+		removeJob(jobstruct);
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinJobs(char **argv, FILE *out)
+DESCRIPTION: the jobs command, displays the background jobs in the order of
+their numbers and forgets the finished ones once they are shown. The states
+come from the exits handle_sigchld() recorded, so no process is probed.
+"jobs -o %num" shows the output captured from that job instead.
+-------------------------------------------------------------------------------*/
+int builtinJobs(char **argv, FILE *out) {
+	struct job *jobstruct;
+	char buf[32];
+	int i;
+
+	drainChildEvents();
+	if (argv[1] != NULL && strcmp(argv[1], "-o") == 0) {
+		if (argv[2] == NULL) {
+			fprintf(stderr, "Usage: jobs -o %%number\n");
+			return 1;
+		}
+		return showJobOutput(argv[2], out);
+	}
+	for (i = 0; i < jobTable.used; i++) {
+		jobstruct = &jobTable.slots[i];
+		if (jobstruct->num == 0) {
+			continue;
+		}
+		fprintf (out, "[%d]\t%d\t%s\t%s\n", jobstruct->num, jobstruct->pid,
+			jobState(jobstruct, buf, sizeof(buf)), jobstruct->command);
+		if (jobstruct->mode == JOB_FINISHED) {
+			retireJob(jobstruct);
+		}
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int jobDone(void *jobstruct)
+DESCRIPTION: waitForChildren() test for the end of one job
+-------------------------------------------------------------------------------*/
+int jobDone(void *jobstruct) {
+	return ((struct job *) jobstruct)->mode != JOB_RUNNING;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int allJobsDone(void *unused)
+DESCRIPTION: waitForChildren() test for the end of every background job
+-------------------------------------------------------------------------------*/
+int allJobsDone(void *unused) {
+	int i;
+	for (i = 0; i < jobTable.used; i++) {
+		if (jobTable.slots[i].num != 0 && jobTable.slots[i].mode == JOB_RUNNING) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinWait(char **argv, FILE *out)
+DESCRIPTION: the wait command. "wait" waits for every background job and
+returns 0, "wait %num" or "wait pid" waits for that job and returns its status.
+The jobs waited for are removed without being reported, unless jobs -o has
+their output still to show.
+-------------------------------------------------------------------------------*/
+int builtinWait(char **argv, FILE *out) {
+	struct job *jobstruct;
+	int i, status = 0;
+
+	if (argv[1] == NULL) {
+		waitForChildren(allJobsDone, NULL);
+		for (i = 0; i < jobTable.used; i++) {
+			if (jobTable.slots[i].num != 0) {
+				retireJob(&jobTable.slots[i]);
+			}
+		}
+		return 0;
+	}
+	for (i = 1; argv[i] != NULL; i++) {
+		jobstruct = jobByArgument(argv[i]);
+		if (jobstruct == NULL) {
+			fprintf (stderr, "yosh: wait: %s: no such job\n", argv[i]);
+			status = 127;
+			continue;
+		}
+		waitForChildren(jobDone, jobstruct);
+		status = exitCode(jobstruct->status);
+		retireJob(jobstruct);
+	}
+	return status;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinKill(char **argv, FILE *out)
+DESCRIPTION: the kill command, kills the process with pid num or the job %num
+-------------------------------------------------------------------------------*/
+int builtinKill(char **argv, FILE *out) {
+	int count = 0; 
+	while(argv[++count] != NULL);
+	if (count < 2 || strlen(argv[1]) < 1) {
+		fprintf (stderr, "Usage: Kill %%number\n");
+		return 1;
+	}
+	struct job *tempjob; // the job to kill
+	int i;
+	drainChildEvents();
+	tempjob = jobByArgument(argv[1]);
+	if (tempjob == NULL || tempjob->mode != JOB_RUNNING) {
+		fprintf (stderr, "yosh: kill: (%s) - No such process\n", argv[1]);
+		return 1;
+	}
+	if (interactive) { // the whole pipeline is in the job's process group
+		if (kill(-tempjob->pid, SIGKILL) < 0) {
+			perror("kill");
+			return 1;
+		}
+	} else {
+		for (i = 0; i < tempjob->stages; i++) {
+			kill(tempjob->pids[i], SIGKILL);
+		}
+	}
+	fprintf(out, "Process killed: %d\n", tempjob->pid);
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinHash(char **argv, FILE *out)
+DESCRIPTION: the hash command. Lists the remembered command paths, "-r" forgets
+them and any names given are looked up and remembered.
+-------------------------------------------------------------------------------*/
+int builtinHash(char **argv, FILE *out) {
+	int i, status = 0;
+	if (argv[1] == NULL) {
+		hash_print(out);
+	}
+	for (i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "-r") == 0) {
+			hash_clear();
+		} else if (hash_lookup(argv[i]) == NULL) {
+			fprintf(stderr, "yosh: hash: %s: not found\n", argv[i]);
+			status = 1;
+		}
+	}
+	return status;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinExit(char **argv, FILE *out)
+DESCRIPTION: the exit command, exits unless there are background jobs still
+running
+-------------------------------------------------------------------------------*/
+int builtinExit(char **argv, FILE *out) {
+	drainChildEvents();
+	if (!allJobsDone(NULL)) {
+		fprintf(out, "There are still jobs running!\n");
+		return 1;
+	}
+	fflush(out);
+	exit(0); // exits and kills the child process
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinYoshstat(char **argv, FILE *out)
+DESCRIPTION: the yoshstat command, shows the counters and latency histograms
+the shell keeps about itself. "-j" shows them as JSON, with every histogram
+bucket, and "-r" sets them back to zero after showing them.
+-------------------------------------------------------------------------------*/
+int builtinYoshstat(char **argv, FILE *out) {
+	int i, json = 0, reset = 0;
+	for (i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "-j") == 0) {
+			json = 1;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			reset = 1;
+		} else {
+			fprintf(stderr, "Usage: yoshstat [-j] [-r]\n");
+			return 1;
+		}
+	}
+	stat_print(out, json);
+	if (reset) {
+		stat_reset();
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinYcat(char **argv, FILE *out)
+DESCRIPTION: ycat [file ...] - concatenates the files, or standard input when
+there are none or for -, onto out. The data is moved by fd_copy() with
+copy_file_range, splice or sendfile and never read into the shell, so ycat at
+the head of a pipeline, which runs inside the shell, feeds the pipe without a
+fork. Returns 1 if a file could not be read, or if writing stopped, as it does
+once the reader of a pipeline goes away.
+-------------------------------------------------------------------------------*/
+int builtinYcat(char **argv, FILE *out) {
+	int outFd = fileno(out), status = 0, fd, err, i;
+	char *stdinName[] = { "ycat", "-", NULL };
+
+	fflush(out); // what is buffered goes first
+	if (argv[1] == NULL) {
+		argv = stdinName;
+	}
+	for (i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "-") == 0) {
+			fd = STDIN_FILENO;
+		} else if ((fd = open(argv[i], O_RDONLY|O_CLOEXEC)) == -1) {
+			perror(argv[i]);
+			status = 1;
+			continue;
+		}
+		err = fd_copy(fd, outFd) == -1 ? errno : 0;
+		if (fd != STDIN_FILENO) {
+			close(fd);
+		}
+		if (err == EPIPE) { // nobody is reading any more
+			return 1;
+		} else if (err != 0) {
+			fprintf(stderr, "ycat: %s: %s\n", argv[i], strerror(err));
+			status = 1;
+		}
+	}
+	return status;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int ycatReadsInput(char **argv)
+DESCRIPTION: whether ycat with these arguments copies standard input, which it
+does without files or for a file named -
+-------------------------------------------------------------------------------*/
+int ycatReadsInput(char **argv) {
+	int i;
+	if (argv[1] == NULL) {
+		return 1;
+	}
+	for (i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "-") == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int workerExited(void *unused)
+DESCRIPTION: waitForChildren() test for a command of parallel having exited
+-------------------------------------------------------------------------------*/
+int workerExited(void *unused) {
+	return pool.exited > 0;
+}
+
+#define PARALLEL_HELD_MAX 1024 // commands parallel keeps unprinted output of at once, two descriptors each
+
+struct parallelJob { // one command run by parallel
+	int out, err; // scratch files holding its output until it is printed
+	int status;
+	int done;
+	int shown; // its output has been printed
+};
+
+/* -----------------------------------------------------------------------------
+FUNCTION: freeParallelArgv(char **argv, char **template, int n)
+DESCRIPTION: frees an argv made by parallelArgv() from the n words of template
+-------------------------------------------------------------------------------*/
+void freeParallelArgv(char **argv, char **template, int n) {
+	int i;
+
+	for (i = 0; i < n && argv[i] != NULL; i++) {
+		if (argv[i] != template[i]) {
+			free(argv[i]);
+		}
+	}
+	free(argv);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: char **parallelArgv(char **template, int n, char *arg)
+DESCRIPTION: the argv of the command parallel runs for arg: the n words of
+template with every {} in them replaced by arg, or with arg appended if none
+has a {}. Words that changed are malloc'd; freeParallelArgv() frees them.
+Returns NULL if memory ran out.
+-------------------------------------------------------------------------------*/
+char **parallelArgv(char **template, int n, char *arg) {
+	char **argv = stat_alloc(malloc((n + 2) * sizeof(char *)));
+	size_t argLen = strlen(arg);
+	int i, replaced = 0;
+
+	if (argv == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < n; i++) {
+		char *from = template[i], *brace, *to;
+		int count = 0;
+		for (brace = strstr(from, "{}"); brace != NULL; brace = strstr(brace + 2, "{}")) {
+			count++;
+		}
+		argv[i] = from;
+		if (count == 0) {
+			continue;
+		}
+		argv[i] = to = stat_alloc(malloc(strlen(from) + count * argLen + 1));
+		if (to == NULL) {
+			freeParallelArgv(argv, template, i);
+			return NULL;
+		}
+		while ((brace = strstr(from, "{}")) != NULL) {
+			memcpy(to, from, brace - from);
+			to += brace - from;
+			memcpy(to, arg, argLen);
+			to += argLen;
+			from = brace + 2;
+		}
+		strcpy(to, from);
+		replaced = 1;
+	}
+	if (!replaced) {
+		argv[n++] = arg;
+	}
+	argv[n] = NULL;
+	return argv;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: printParallelJob(struct parallelJob *job, FILE *out)
+DESCRIPTION: copies what a command of parallel wrote to out, and what it wrote
+to standard error there, in one piece, and closes its scratch files.
+-------------------------------------------------------------------------------*/
+void printParallelJob(struct parallelJob *job, FILE *out) {
+	fflush(out);
+	if (job->out != -1) {
+		lseek(job->out, 0, SEEK_SET);
+		fd_copy(job->out, fileno(out));
+		close(job->out);
+	}
+	if (job->err != -1) {
+		lseek(job->err, 0, SEEK_SET);
+		fd_copy(job->err, STDERR_FILENO);
+		close(job->err);
+	}
+	job->out = job->err = -1;
+}
+
+pid_t spawnStage(char *path, char **argv, int stageIn, int stageOut, struct redirect *redirs,
+		pid_t pgid, int takeTerminal); // the launcher, below
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int builtinParallel(char **argv, FILE *out)
+DESCRIPTION: parallel [-j N] [-k] command [word ...] [::: arg ...] - runs
+command once for every arg, or for every line of standard input when there
+is no :::, with {} in its words replaced by the arg, or the arg added at the
+end. At most N commands run at once, the number of online cores by default.
+The next one starts as soon as one exits: their exits come in through
+SIGCHLD and waitForChildren(), like those of every other child, and nothing
+is polled. The output of each command, standard output then standard error,
+is kept in scratch files and printed in one piece when it exits, or with -k
+in the order of the args. Commands read /dev/null when the args come from
+standard input. In an interactive shell they share a process group that is
+handed the terminal, so ^C stops them, and no more are started after that.
+No more than PARALLEL_HELD_MAX commands, fewer if RLIMIT_NOFILE is low, keep
+output that is not printed yet: with -k and a slow first command, the next
+one only starts once that has been printed.
+Returns the number of commands that failed, at most 101, or 130 after ^C.
+-------------------------------------------------------------------------------*/
+int builtinParallel(char **argv, FILE *out) {
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+	char **template, **args = NULL, **jobArgv, *path, *arg, *line = NULL;
+	struct parallelJob *jobs = NULL, *job;
+	int keepOrder = 0, running = 0, failed = 0, stop = 0, interrupted = 0, nullIn = 0;
+	int jobCount = 0, jobCap = 0, printed = 0, n, i, slot, err;
+	int held = 0, heldMax = PARALLEL_HELD_MAX, exhausted = 0;
+	int *slotJob;
+	const char *what;
+	struct rlimit files;
+	int inShell, terminal;
+	size_t lineCap = 0;
+	ssize_t lineLen;
+	struct sigaction current;
+	sigset_t saved;
+	pid_t pgid = 0, pid;
+
+	for (i = 1; argv[i] != NULL && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-k") == 0) {
+			keepOrder = 1;
+		} else if (strncmp(argv[i], "-j", 2) == 0 && (argv[i][2] != '\0' || argv[i + 1] != NULL)) {
+			workers = atol(argv[i][2] != '\0' ? argv[i] + 2 : argv[++i]);
+			if (workers < 1) {
+				break;
+			}
+		} else if (strcmp(argv[i], "--") == 0) {
+			i++;
+			break;
+		} else {
+			break;
+		}
+	}
+	template = &argv[i];
+	for (n = 0; template[n] != NULL && strcmp(template[n], ":::") != 0; n++);
+	if (n == 0 || workers < 1) {
+		fprintf(stderr, "Usage: parallel [-j N] [-k] command [{}] [::: args]\n");
+		return 2;
+	}
+	if (template[n] != NULL) {
+		args = &template[n + 1];
+	}
+	path = hash_lookup(template[0]);
+	if (path == NULL) {
+		fprintf(stderr, "%s: Command not found.\n", template[0]);
+		return 127;
+	}
+	if (args == NULL && (nullIn = open("/dev/null", O_RDONLY|O_CLOEXEC)) == -1) {
+		perror("/dev/null");
+		return 1;
+	}
+	if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY &&
+			(long) files.rlim_cur < 2L * heldMax + 64) { // room for the shell's own descriptors
+		heldMax = files.rlim_cur > 66 ? (files.rlim_cur - 64) / 2 : 1;
+	}
+
+	pool.pids = stat_alloc(calloc(workers, sizeof(pid_t)));
+	pool.statuses = stat_alloc(malloc(workers * sizeof(int)));
+	slotJob = stat_alloc(malloc(workers * sizeof(int)));
+	if (pool.pids == NULL || pool.statuses == NULL || slotJob == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		free(pool.pids);
+		free(pool.statuses);
+		free(slotJob);
+		pool.pids = NULL;
+		return 1;
+	}
+	sigaction(SIGCHLD, NULL, &current);
+	inShell = current.sa_handler == handle_sigchld;
+	if (!inShell) { // a stage forked for a pipeline gets its own exits, and its own wake-ups
+		close(selfPipe[0]);
+		close(selfPipe[1]);
+		if (pipe2(selfPipe, O_NONBLOCK|O_CLOEXEC) == -1) {
+			perror("pipe");
+		}
+		signal(SIGCHLD, handle_sigchld);
+	}
+	terminal = inShell && interactive;
+	sigprocmask(SIG_BLOCK, &chldMask, &saved); // exits are taken in waitForChildren(), between launches
+	pool.n = workers;
+	pool.exited = 0;
+
+	while (1) {
+		while (running < workers && held < heldMax && !stop && !exhausted) {
+			if (args != NULL) {
+				arg = *args != NULL ? *args++ : NULL;
+			} else if ((lineLen = getline(&line, &lineCap, stdin)) != -1) {
+				if (lineLen > 0 && line[lineLen - 1] == '\n') {
+					line[lineLen - 1] = '\0';
+				}
+				arg = line;
+			} else {
+				clearerr(stdin);
+				arg = NULL;
+			}
+			if (arg == NULL) {
+				exhausted = 1;
+				break;
+			}
+			if (jobCount == jobCap) {
+				struct parallelJob *grown = stat_alloc(realloc(jobs, (jobCap ? 2 * jobCap : 64) * sizeof(struct parallelJob)));
+				if (grown == NULL) {
+					fprintf(stderr, "Out of memory.\n");
+					failed++;
+					stop = 1;
+					break;
+				}
+				jobs = grown;
+				jobCap = jobCap ? 2 * jobCap : 64;
+			}
+			job = &jobs[jobCount++];
+			job->done = job->shown = 0;
+			job->out = job->err = -1;
+			held++;
+			jobArgv = NULL;
+			pid = -1;
+			what = "parallel";
+			if ((job->out = openScratchFile("yosh-parallel")) == -1 ||
+					(job->err = openScratchFile("yosh-parallel")) == -1) {
+				err = errno;
+			} else if ((jobArgv = parallelArgv(template, n, arg)) == NULL) {
+				err = ENOMEM;
+			} else {
+				struct redirect toErr = { REDIR_DUP, 2, job->err, NULL, NULL, 0, NULL };
+				struct redirect toOut = { REDIR_DUP, 1, job->out, NULL, NULL, 0, &toErr };
+				pid = spawnStage(path, jobArgv, nullIn, 1, &toOut,
+						terminal ? pgid : getpgrp(), terminal && pgid == 0);
+				err = errno;
+				what = template[0];
+			}
+			if (pid == -1) {
+				fprintf(stderr, "%s: %s\n", what, strerror(err));
+				job->status = W_EXITCODE(127, 0);
+				job->done = 1;
+				failed++;
+			} else {
+				stat_count(STAT_SPAWNS);
+				stat_count(STAT_EXECS);
+				for (slot = 0; pool.pids[slot] != 0; slot++);
+				pool.pids[slot] = pid;
+				pool.statuses[slot] = -1;
+				slotJob[slot] = jobCount - 1;
+				running++;
+				if (pgid == 0) {
+					pgid = pid;
+				}
+			}
+			if (jobArgv != NULL) {
+				freeParallelArgv(jobArgv, template, n);
+			}
+		}
+
+		for (i = printed; i < jobCount && (jobs[i].done || !keepOrder); i++) { // what can be printed already
+			if (jobs[i].done && !jobs[i].shown) {
+				printParallelJob(&jobs[i], out);
+				jobs[i].shown = 1;
+				held--;
+			}
+		}
+		while (printed < jobCount && jobs[printed].shown) {
+			printed++;
+		}
+		if (running == 0 && (stop || exhausted)) {
+			break;
+		}
+		if (running == 0) {
+			continue; // everything held was printed, the next ones can start
+		}
+
+		waitForChildren(workerExited, NULL);
+		for (slot = 0; slot < workers; slot++) {
+			if (pool.pids[slot] == 0 || pool.statuses[slot] == -1) {
+				continue;
+			}
+			job = &jobs[slotJob[slot]];
+			job->status = pool.statuses[slot];
+			job->done = 1;
+			pool.pids[slot] = 0;
+			running--;
+			if (!WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0) {
+				failed++;
+			}
+			if (WIFSIGNALED(job->status) && WTERMSIG(job->status) == SIGINT) {
+				interrupted = stop = 1;
+			}
+		}
+		pool.exited = 0;
+		if (running == 0) {
+			pgid = 0; // the process group is gone with its last member
+		}
+	}
+
+	pool.n = 0;
+	free(pool.pids);
+	free(pool.statuses);
+	pool.pids = NULL;
+	pool.statuses = NULL;
+	free(slotJob);
+	free(jobs);
+	free(line);
+	if (nullIn != 0) {
+		close(nullIn);
+	}
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+	if (terminal) {
+		tcsetpgrp(STDIN_FILENO, getpgrp());
+	}
+	if (interrupted) {
+		return 130;
+	}
+	return failed > 100 ? 101 : failed;
+}
+
+struct builtin { // the name and handler of a builtin, indexed by enum BUILTIN_COMMANDS
+	const char *name;
+	int (*handler)(char **argv, FILE *out);
+	int inProcess; // may run inside the shell at the head of a pipeline
+	int (*readsInput)(char **argv); // whether it reads standard input with argv, NULL if never
+};
+
+/* Builtins that only report on the shell write their output straight into the
+ * pipeline from the shell process, so they are marked inProcess. cd and exit
+ * are not: like in other shells, a pipeline must not move or end the shell.
+ * Nor is parallel, which waits for commands of its own while the rest of the
+ * pipeline runs, and whose commands belong in the pipeline's process group.
+ * One that reads standard input is forked all the same when readsInput says it
+ * will, so that the terminal, Ctrl-C included, goes to its process group and a
+ * script's input is not read by the shell. */
+const struct builtin builtins[] = {
+	[NO_SUCH_BUILTIN] = { "", NULL, 0, NULL },
+	[EXIT] = { "exit", builtinExit, 0, NULL },
+	[JOBS] = { "jobs", builtinJobs, 1, NULL },
+	[HISTORY] = { "history", builtinHistory, 1, NULL },
+	[KILL] = { "kill", builtinKill, 1, NULL },
+	[CD] = { "cd", builtinCd, 0, NULL },
+	[HELP] = { "help", builtinHelp, 1, NULL },
+	[HASH] = { "hash", builtinHash, 1, NULL },
+	[WAIT] = { "wait", builtinWait, 0, NULL },
+	[YOSHSTAT] = { "yoshstat", builtinYoshstat, 1, NULL },
+	[YCAT] = { "ycat", builtinYcat, 1, ycatReadsInput },
+	[PARALLEL] = { "parallel", builtinParallel, 0, NULL }
+};
+
+/* BUILTIN_HASH() is a perfect hash of the builtin names above: it mixes the
+ * length with the first and last character, and no two names land in the same
+ * slot. builtinSlots is built from builtins[] on the first lookup, so
+ * registering a builtin only takes its entry there; initBuiltinSlots() checks
+ * that the hash stays perfect and stops the shell if a new name collides, in
+ * which case the mix needs changing. */
+#define BUILTIN_HASH_SIZE 32
+#define BUILTIN_HASH(len, first, last) (((len) + (first) + (last)) & (BUILTIN_HASH_SIZE - 1))
+
+unsigned char builtinSlots[BUILTIN_HASH_SIZE];
+int builtinSlotsReady = 0;
+
+/* -----------------------------------------------------------------------------
+FUNCTION: initBuiltinSlots()
+DESCRIPTION: puts every builtin of builtins[] in the builtinSlots slot its name
+hashes to, once. Two names in the same slot are a bug in the hash, reported
+before the shell runs anything.
+-------------------------------------------------------------------------------*/
+void initBuiltinSlots() {
+	size_t i, len;
+	int slot;
+
+	for (i = 1; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+		len = strlen(builtins[i].name);
+		slot = BUILTIN_HASH(len, builtins[i].name[0], builtins[i].name[len - 1]);
+		if (builtinSlots[slot] != NO_SUCH_BUILTIN) {
+			fprintf(stderr, "yosh: builtins %s and %s hash to the same slot %d\n",
+				builtins[builtinSlots[slot]].name, builtins[i].name, slot);
+			abort();
+		}
+		builtinSlots[slot] = i;
+	}
+	builtinSlotsReady = 1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int isBuiltInCommand(char *cmd)
+DESCRIPTION: returns the enum BUILTIN_COMMANDS value of the builtin named
+exactly cmd, or NO_SUCH_BUILTIN. The lookup is a single probe of builtinSlots
+followed by one strcmp. parse() calls this once for every command it reads and
+keeps the result in commandType.builtin, so the rest of the shell dispatches on
+that instead of looking the name up again.
+-------------------------------------------------------------------------------*/
+int isBuiltInCommand(const char *cmd)
+{
+	size_t len = strlen(cmd);
+	int builtin;
+
+	if (!builtinSlotsReady) {
+		initBuiltinSlots();
+	}
+	if (len == 0) {
+		return NO_SUCH_BUILTIN;
+	}
+	builtin = builtinSlots[BUILTIN_HASH(len, cmd[0], cmd[len - 1])];
+	if (builtin != NO_SUCH_BUILTIN && strcmp(builtins[builtin].name, cmd) == 0) {
+		return builtin;
+	}
+	return NO_SUCH_BUILTIN;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int executeBuiltInCommand(int builtin, char **argv, FILE *out)
+DESCRIPTION: runs the builtin with the given enum BUILTIN_COMMANDS value,
+writing its output to out, and returns its exit status. The caller flushes
+out.
+-------------------------------------------------------------------------------*/
+int executeBuiltInCommand(int builtin, char **argv, FILE *out) {
+	stat_count(STAT_BUILTINS);
+	return builtins[builtin].handler(argv, out);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int executeCommand(char *path, char **argv) {
+DESCRIPTION: Replaces the calling child process with the external command
+argv[0]. path is the location hash_lookup() resolved for it in the parent, so
+the child does not search $PATH again; NULL means the command was not found.
+Only returns on failure, with errno set. A hashed file that has disappeared
+fails with ENOENT, which the child passes back to launchPipeline() so that the
+parent forgets the entry.
+-------------------------------------------------------------------------------*/
+int executeCommand(char *path, char **argv) {
+	if (path == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	return execv(path, argv);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: forgetStaleCommands(parseInfo *info, char *stale)
+DESCRIPTION: drops the hash table entries of the stages whose exec found nothing
+at the hashed path, ENOENT or ENOTDIR as spawnStage() or the forked child
+reported it, so they are looked up again on the next run. A command that ran
+and exited with 127 keeps its entry.
+-------------------------------------------------------------------------------*/
+void forgetStaleCommands(parseInfo *info, char *stale) {
+	int i;
+	for (i = 0; i <= info->pipeNum; i++) {
+		if (stale[i]) {
+			hash_remove(info->CommArray[i].command);
+		}
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: watchPipeline(pid_t *pids, int n, int *statuses, struct stageTimes *times)
+DESCRIPTION: makes the n stages of a pipeline started by launchPipeline() the
+foreground pipeline, so that their exits are recorded from then on, even when
+a builtin of the shell drains the child events before waitPipeline() runs.
+Stages that ran inside the shell have a pid of 0 and are skipped. The status of
+every stage is stored in statuses when it is not NULL; the last one is the
+status of the pipeline. When times is not NULL, the resource usage wait4()
+returned for every stage and the time it was reaped are stored there too.
+-------------------------------------------------------------------------------*/
+void watchPipeline(pid_t *pids, int n, int *statuses, struct stageTimes *times) {
+	int i;
+
+	if (statuses == NULL) {
+		statuses = arena_alloc(&lineArena, n * sizeof(int));
+	}
+	fg.pids = pids;
+	fg.statuses = statuses;
+	fg.times = times;
+	fg.left = 0;
+	for (i = 0; i < n; i++) {
+		statuses[i] = 0;
+		if (pids[i] > 0) {
+			fg.left++;
+		}
+	}
+	fg.n = n;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: waitPipeline()
+DESCRIPTION: Waits for all the stages of the pipeline watchPipeline() recorded,
+in whatever order they finish. The stages are reaped by handle_sigchld() like
+every other child, and their statuses are picked out of the child events. The
+terminal is taken back from the pipeline's process group afterwards.
+-------------------------------------------------------------------------------*/
+void waitPipeline() {
+	waitForChildren(foregroundDone, NULL);
+	fg.n = 0;
+
+	if (interactive) {
+		tcsetpgrp(STDIN_FILENO, getpgrp());
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: pid_t spawnStage(char *path, char **argv, int stageIn, int stageOut,
+	struct redirect *redirs, pid_t pgid, int takeTerminal)
+DESCRIPTION: starts the external command at path with posix_spawn, which does
+not copy the shell's page tables the way fork does. The same setup as the
+forked child in launchPipeline() is expressed as spawn attributes and file
+actions: stageIn and stageOut are dup2'd onto standard input and output, then
+the redirections of the stage are applied, the process group is set in
+interactive mode, and the signals the shell ignores and its signal mask are
+restored. Every other descriptor the shell holds is
+close-on-exec. Returns the pid, or -1 with errno set if the command could not
+be started, including when it turned out not to exist.
+-------------------------------------------------------------------------------*/
+pid_t spawnStage(char *path, char **argv, int stageIn, int stageOut, struct redirect *redirs,
+		pid_t pgid, int takeTerminal) {
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t defaults;
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	pid_t pid;
+	int err;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
+	if (stageIn != 0) {
+		posix_spawn_file_actions_adddup2(&actions, stageIn, STDIN_FILENO);
+	}
+	if (stageOut != 1) {
+		posix_spawn_file_actions_adddup2(&actions, stageOut, STDOUT_FILENO);
+	}
+	addRedirections(&actions, redirs);
+	if (interactive) {
+		flags |= POSIX_SPAWN_SETPGROUP;
+		posix_spawnattr_setpgroup(&attr, pgid);
+		if (takeTerminal) { // signals are blocked in the child until it execs, so SIGTTOU cannot stop it here
+			posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+		}
+	}
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGTTOU);
+	sigaddset(&defaults, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setsigmask(&attr, &origMask);
+	posix_spawnattr_setflags(&attr, flags);
+
+	err = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	return pid;
+}
+
+struct fanOut { // the pipes of a |& group, -1 once handed over or closed
+	int source[2]; // the producer writes into source[1]
+	int n; // consumers
+	int *consumers; // the read and write end of each consumer's pipe, in turn
+};
+
+/* -----------------------------------------------------------------------------
+FUNCTION: closeFanOut(struct fanOut *fan)
+DESCRIPTION: closes the pipes of fan that are still open and frees it.
+-------------------------------------------------------------------------------*/
+void closeFanOut(struct fanOut *fan) {
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (fan->source[i] != -1) {
+			close(fan->source[i]);
+		}
+	}
+	for (i = 0; i < 2 * fan->n; i++) {
+		if (fan->consumers[i] != -1) {
+			close(fan->consumers[i]);
+		}
+	}
+	free(fan->consumers);
+	free(fan);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: struct fanOut *openFanOut(int n)
+DESCRIPTION: creates the pipe a producer writes into and one pipe for each of
+n consumers, all close-on-exec. It is malloc'd, not in lineArena, because the
+pump thread may outlive the line. Returns NULL on failure.
+-------------------------------------------------------------------------------*/
+struct fanOut *openFanOut(int n) {
+	struct fanOut *fan = stat_alloc(malloc(sizeof(struct fanOut)));
+	int i;
+
+	if (fan == NULL || (fan->consumers = stat_alloc(malloc(2 * n * sizeof(int)))) == NULL) {
+		free(fan);
+		fprintf(stderr, "Out of memory.\n");
+		return NULL;
+	}
+	fan->n = n;
+	fan->source[0] = fan->source[1] = -1;
+	for (i = 0; i < 2 * n; i++) {
+		fan->consumers[i] = -1;
+	}
+	if (pipe2(fan->source, O_CLOEXEC) == -1) {
+		perror("pipe");
+		closeFanOut(fan);
+		return NULL;
+	}
+	for (i = 0; i < n; i++) {
+		if (pipe2(&fan->consumers[2 * i], O_CLOEXEC) == -1) {
+			perror("pipe");
+			closeFanOut(fan);
+			return NULL;
+		}
+	}
+	return fan;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: void *pumpFanOut(void *arg)
+DESCRIPTION: the pump thread of a |& group: copies what the producer writes
+into the pipe of every consumer with fd_fanout() until the producer is done,
+which closes the pipes, then frees the struct fanOut it was given.
+-------------------------------------------------------------------------------*/
+void *pumpFanOut(void *arg) {
+	struct fanOut *fan = arg;
+	int *outs = stat_alloc(malloc(fan->n * sizeof(int)));
+	int i;
+
+	if (outs == NULL) {
+		closeFanOut(fan);
+		return NULL;
+	}
+	for (i = 0; i < fan->n; i++) {
+		outs[i] = fan->consumers[2 * i + 1];
+		fan->consumers[2 * i + 1] = -1;
+	}
+	if (fd_fanout(fan->source[0], outs, fan->n) == -1) {
+		perror("|&");
+	}
+	fan->source[0] = -1;
+	free(outs);
+	closeFanOut(fan);
+	return NULL;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int startFanOut(struct fanOut *fan)
+DESCRIPTION: starts the detached pump thread that takes over fan, once every
+stage of the pipeline has its end of the pipes. The thread blocks every
+signal, so that SIGCHLD is only ever handled by the shell's own thread.
+Returns -1, with fan still the caller's, if the thread could not be started.
+-------------------------------------------------------------------------------*/
+int startFanOut(struct fanOut *fan) {
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t all, old;
+	int err;
+
+	sigfillset(&all);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_sigmask(SIG_SETMASK, &all, &old); // inherited by the thread
+	err = pthread_create(&thread, &attr, pumpFanOut, fan);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+	if (err != 0) {
+		fprintf(stderr, "|&: %s\n", strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: launchPipeline(parseInfo *info, pid_t *pids, int *statuses,
+	struct stageTimes *times, int foreground)
+DESCRIPTION: Starts every stage of info->CommArray at once, the way a real
+pipeline has to run: a producer that writes more than a pipe buffer would
+otherwise block forever waiting for a consumer that has not been forked yet.
+All the pipes are created by the parent, each stage is forked with its end of
+the chain dup2'd onto standard input and output, and the parent closes its copy
+of every pipe end as soon as the stage using it exists. The redirections of a
+stage are applied in it after the pipes, so 2>&1 sends standard error down the
+pipe too; here-documents are opened by the parent and shared. When the shell is
+interactive the stages share one process group whose id is the pid of the first
+stage, and that group is handed the terminal if foreground is set; batch mode
+does no job control and leaves them in the shell's group.
+External commands are started with posix_spawn by default and with fork when
+the shell is run with -l fork; builtins that need a process always fork.
+With a |& group, the last stage of the producer writes into the pipe of a
+pump thread instead, the first stage of every consumer reads from a pipe of
+its own that the pump copies the stream into, and the last stage of every
+consumer writes to standard output. All of them are stages of the same job.
+A builtin marked inProcess at the head of a foreground pipeline, without
+redirections and not about to read standard input, is not forked: once the rest of the pipeline runs, the shell
+itself runs it with its output going straight into the first pipe through a
+buffered stream, and its pid is 0. The shell keeps the terminal until the
+builtin returns, so that it can still read it, and only then hands it to the
+pipeline, waking any stage that was stopped for reading it too early. A
+background pipeline always forks its builtins.
+The pids of the stages are stored in pids, which must hold pipeNum + 1
+entries. A foreground pipeline is handed to watchPipeline() with statuses and
+times before the head builtin runs, since jobs, kill and parallel drain child
+events themselves; waitPipeline() then waits for it. Returns the pid of the
+first forked stage, which is the process group id in interactive mode, or -1
+if nothing was started. The caller is expected to have SIGCHLD blocked until
+the pids are recorded, here or in the job table, so that their exits cannot be
+drained before the shell knows them.
+-------------------------------------------------------------------------------*/
+pid_t launchPipeline(parseInfo *info, pid_t *pids, int *statuses, struct stageTimes *times,
+		int foreground) {
+	int fds[2];
+	int execErr[2]; // with fork, the child writes the errno of a failed exec here
+	int stageIn, stageOut, i;
+	int headOut = -1; // the pipe an in-process builtin at the head writes to
+	struct commandType *first = &info->CommArray[0];
+	int inShell = foreground && info->pipeNum > 0 && builtins[first->builtin].inProcess &&
+		first->redirs == NULL && (builtins[first->builtin].readsInput == NULL ||
+		!builtins[first->builtin].readsInput(first->VarList)); // the head builtin runs in the shell
+	int takeTerminal = foreground && interactive && !inShell; // the first stage takes it itself
+	struct fanOut *fan = NULL;
+	char **paths = arena_alloc(&lineArena, (info->pipeNum + 1) * sizeof(char *));
+	char *stale = arena_alloc(&lineArena, info->pipeNum + 1); // exec found no file at the hashed path
+	pid_t pgid = 0;
+
+	if (openHereDocuments(info) == -1) {
+		return -1;
+	}
+	if (info->fanOut > 0 && (fan = openFanOut(info->fanOut)) == NULL) {
+		closeHereDocuments(info);
+		return -1;
+	}
+	for (i = 0; i <= info->pipeNum; i++) { // resolved here so the parent's hash table remembers them
+		char *command = info->CommArray[i].command;
+		paths[i] = NULL;
+		stale[i] = 0;
+		if (command != NULL && info->CommArray[i].builtin == NO_SUCH_BUILTIN) {
+			paths[i] = hash_lookup(command);
+		}
+	}
+	fflush(stdout); // or the children would inherit and repeat what is buffered
+	fflush(stderr);
+	stageIn = 0; // the first stage reads from standard input
+	for (i = 0; i <= info->pipeNum; i++) {
+		struct commandType *stage = &info->CommArray[i];
+
+		if (stage->branch > 0 && info->CommArray[i - 1].branch != stage->branch) {
+			stageIn = fan->consumers[2 * (stage->branch - 1)]; // the head of a consumer
+			fan->consumers[2 * (stage->branch - 1)] = -1;
+		}
+		fds[0] = -1;
+		stageOut = 1; // the last stage writes to standard output
+		if (i < info->pipeNum && info->CommArray[i + 1].branch == stage->branch) {
+			if (pipe2(fds, O_CLOEXEC) == -1) {
+				perror("pipe");
+				break;
+			}
+			stageOut = fds[1];
+		} else if (i < info->pipeNum && stage->branch == 0) {
+			stageOut = fan->source[1]; // the end of the producer feeds the pump
+			fan->source[1] = -1;
+		}
+
+		if (i == 0 && inShell) {
+			pids[0] = 0; // runs below, once its readers exist
+			headOut = stageOut;
+			if (stageIn != 0) {
+				close(stageIn);
+			}
+			stageIn = fds[0] != -1 ? fds[0] : 0;
+			continue;
+		}
+
+		pids[i] = -1;
+		execErr[0] = execErr[1] = -1;
+		if (launcher == LAUNCH_SPAWN && stage->builtin == NO_SUCH_BUILTIN && paths[i] != NULL) {
+			pids[i] = spawnStage(paths[i], stage->VarList, stageIn, stageOut, stage->redirs,
+					pgid, takeTerminal && pgid == 0);
+			if (pids[i] != -1) {
+				stat_count(STAT_SPAWNS);
+				stat_count(STAT_EXECS);
+			} else if (errno == ENOENT || errno == ENOTDIR) {
+				stale[i] = 1;
+			}
+		} else if (stage->builtin == NO_SUCH_BUILTIN && paths[i] != NULL &&
+				pipe2(execErr, O_CLOEXEC) == -1) { // the forked child reports why its exec failed here
+			execErr[0] = execErr[1] = -1;
+		}
+		if (pids[i] == -1) { // builtins, and commands that failed to spawn so the child reports why
+			pids[i] = fork();
+			if (pids[i] > 0) {
+				stat_count(STAT_FORKS);
+				if (stage->builtin == NO_SUCH_BUILTIN && stage->command != NULL) {
+					stat_count(STAT_EXECS);
+				}
+			}
+		}
+		if (pids[i] == 0) {
+			if (interactive) {
+				setpgid(0, pgid);
+			}
+			if (takeTerminal) {
+				tcsetpgrp(STDIN_FILENO, pgid ? pgid : getpid());
+			}
+			signal(SIGTTOU, SIG_DFL);
+			signal(SIGCHLD, SIG_DFL);
+			signal(SIGPIPE, SIG_DFL);
+			sigprocmask(SIG_SETMASK, &origMask, NULL);
+
+			if (stageIn != 0) { // only occurs if the stage does not read standard input
+				dup2(stageIn, STDIN_FILENO);
+				close(stageIn);
+			}
+			if (stageOut != 1) { // only occurs if the stage does not write standard output
+				dup2(stageOut, STDOUT_FILENO);
+				close(stageOut);
+			}
+			if (fds[0] != -1) {
+				close(fds[0]); // the read end belongs to the next stage
+			}
+			if (headOut != -1) {
+				close(headOut);
+			}
+			if (fan != NULL) {
+				closeFanOut(fan); // the pipes of the other consumers
+			}
+			if (jobOutput != -1) { // a forked builtin must not read the output of the shell's jobs
+				close(jobOutput);
+				jobOutput = -1;
+			}
+			if (applyRedirections(stage->redirs) == -1) {
+				exit(1);
+			}
+			if (stage->command == NULL) {
+				exit(0);
+			}
+			if (stage->builtin != NO_SUCH_BUILTIN) {
+				exit(executeBuiltInCommand(stage->builtin, stage->VarList, stdout));
+			}
+			executeCommand(paths[i], stage->VarList);
+			if (execErr[1] != -1) {
+				int err = errno;
+				fd_write(execErr[1], &err, sizeof(err));
+				errno = err;
+			}
+			if (errno == ENOENT) {
+				fprintf(stderr, "%s: Command not found.\n", stage->command);
+				exit(127);
+			}
+			perror(stage->command);
+			exit(126);
+		}
+		if (execErr[0] != -1) { // end of file once the child has exec'd
+			int err;
+			ssize_t n = 0;
+			close(execErr[1]);
+			while (pids[i] > 0 && (n = read(execErr[0], &err, sizeof(err))) == -1 && errno == EINTR);
+			if (pids[i] > 0 && n == sizeof(err) && (err == ENOENT || err == ENOTDIR)) {
+				stale[i] = 1;
+			}
+			close(execErr[0]);
+		}
+		if (pids[i] < 0) {
+			perror("fork");
+			if (fds[0] != -1) {
+				close(fds[0]);
+			}
+			if (stageOut != 1) {
+				close(stageOut);
+			}
+			break;
+		}
+
+		if (pgid == 0) {
+			pgid = pids[i];
+		}
+		if (interactive) {
+			setpgid(pids[i], pgid); // also done by the child, whichever runs first wins
+		}
+
+		if (stageIn != 0) {
+			close(stageIn);
+		}
+		if (stageOut != 1) {
+			close(stageOut);
+		}
+		stageIn = fds[0] != -1 ? fds[0] : 0;
+	}
+	if (i <= info->pipeNum && stageIn != 0) {
+		close(stageIn); // a failed launch leaves the last read end open
+	}
+	closeHereDocuments(info);
+	forgetStaleCommands(info, stale); // no child is forked with paths any more
+	if (fan != NULL && (i <= info->pipeNum || startFanOut(fan) == -1)) {
+		closeFanOut(fan); // the producer gets SIGPIPE and the consumers end of file
+	}
+	if (i <= info->pipeNum) { // something went wrong before every stage was started
+		int j;
+		if (headOut != -1) {
+			close(headOut);
+		}
+		for (j = 0; j < i; j++) {
+			if (pids[j] > 0) {
+				kill(pids[j], SIGKILL);
+			}
+		}
+		watchPipeline(pids, i, NULL, NULL);
+		waitPipeline();
+		return -1;
+	}
+	if (foreground) {
+		watchPipeline(pids, info->pipeNum + 1, statuses, times);
+	}
+	if (headOut != -1) {
+		FILE *fp = fdopen(headOut, "w");
+		if (fp == NULL) {
+			perror("fdopen");
+			close(headOut);
+		} else {
+			executeBuiltInCommand(first->builtin, first->VarList, fp);
+			fclose(fp); // flushes, and the readers see end of file
+		}
+	}
+	if (foreground && interactive && pgid != 0) {
+		tcsetpgrp(STDIN_FILENO, pgid);
+		if (inShell) { // a stage that read the terminal before it had it was stopped by SIGTTIN
+			kill(-pgid, SIGCONT);
+		}
+	}
+	return pgid;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: openInput(int fd, const char *text)
+DESCRIPTION: prepares input for batch mode, which bypasses readline. Lines are
+read from fd in large blocks, or taken from text when it is not NULL (yosh -c).
+-------------------------------------------------------------------------------*/
+void openInput(int fd, const char *text) {
+	input.fd = fd;
+	input.start = input.end = 0;
+	input.eof = 0;
+	if (text != NULL) {
+		input.size = strlen(text) + 1;
+		input.buf = stat_alloc(strdup(text));
+		input.end = input.size - 1;
+		input.eof = 1;
+	} else {
+		input.size = INPUT_BLOCK_SIZE;
+		input.buf = stat_alloc(malloc(input.size));
+	}
+}
 
-		com = &info->CommArray[0];
+/* -----------------------------------------------------------------------------
+FUNCTION: char *readInputLine()
+DESCRIPTION: returns the next line of batch input with its newline replaced by
+'\0', or NULL at the end of the input. The line lives in the input buffer and
+is only valid until the next call. The buffer grows for lines longer than it.
+-------------------------------------------------------------------------------*/
+char *readInputLine() {
+	char *line, *nl;
+	ssize_t got;
 
-		//insert your code here / commands etc.
-		int i, j;
-		wordexp_t p;
-		if (com->VarNum > 1) {
-			for (i = 1; i < com->VarNum; i++) {
-				if (strstr(com->VarList[i], "~")) {
-					wordexp(com->VarList[i], &p, 0);
-					com->VarList[i] = strdup(p.we_wordv[0]);
-					wordfree(&p);
+	while (1) {
+		nl = memchr(input.buf + input.start, '\n', input.end - input.start);
+		if (nl != NULL || (input.eof && input.start < input.end)) {
+			line = input.buf + input.start;
+			if (nl == NULL) { // the last line has no newline
+				if (input.end == input.size) {
+					input.buf = stat_alloc(realloc(input.buf, ++input.size));
+					line = input.buf + input.start;
 				}
+				nl = input.buf + input.end;
 			}
-		}
-		
-		for (i = 0; i <= info->pipeNum; i++) { // removes all '' and "" for things like grep 'txt$' and grep "txt$"
-			int max = (&(info->CommArray[i]))->VarNum; // the number of arguments for each command in the loop
-			for (j = 0; j < max; j++) {
-				if (((&(info->CommArray[i]))->VarList[j][0] == '\'' && 
-				(&(info->CommArray[i]))->VarList[j][strlen((&(info->CommArray[i]))->VarList[j]-1)] == '\'') ||
-				((&(info->CommArray[i]))->VarList[j][0] == '"' && 
-				(&(info->CommArray[i]))->VarList[j][strlen((&(info->CommArray[i]))->VarList[j]-1)] == '"')) {
-					memmove((&(info->CommArray[i]))->VarList[j], (&(info->CommArray[i]))->VarList[j]+1, strlen((&(info->CommArray[i]))->VarList[j]));
-					(&(info->CommArray[i]))->VarList[j][strlen((&(info->CommArray[i]))->VarList[j])-1] = '\0';
-				}
+			*nl = '\0';
+			input.start = nl - input.buf + 1;
+			if (input.start > input.end) {
+				input.start = input.end;
 			}
-		} 
+			return line;
+		}
+		if (input.eof) {
+			return NULL;
+		}
 
-		//com contains the info. of the command before the first "|"
-		
-		if ((com == NULL) || (com->command == NULL)) {
-			free_info(info);
-			free(cmdLine);
+		if (input.start > 0) { // slides the partial line to the front to make room
+			memmove(input.buf, input.buf + input.start, input.end - input.start);
+			input.end -= input.start;
+			input.start = 0;
+		}
+		if (input.end == input.size) {
+			input.size *= 2;
+			input.buf = stat_alloc(realloc(input.buf, input.size));
+		}
+		got = read(input.fd, input.buf + input.end, input.size - input.end);
+		if (got < 0 && errno == EINTR) {
 			continue;
 		}
-			
-		//com->command tells the command name of com
-		else if (info->pipeNum == 0 && isBuiltInCommand(com->command)) {
-			int childNeeded = 0;
-			if (info->boolInfile || info->boolOutfile) {
-				childNeeded = 1; // determines if a fork is needed for input redir purposes
-			}
-			if (childNeeded == 1) {
-				childPid = fork(); // creates the fork to allow dup2 to function properly
-				if (childPid == 0) {
-					if (redirectionTester(info) == -1) { // tests and implements input redirection
-						continue; // exits preemptively before commands are run
-					}
-					executeBuiltInCommand(com->command, com->VarList, 1); //calls execvp
-				}
-				waitpid(childPid, NULL, 0);
-			} else {
-				executeBuiltInCommand(com->command, com->VarList, 0); //calls execvp
-			}
+		if (got <= 0) {
+			input.eof = 1;
 		} else {
-			childPid = fork();
-			if (childPid == 0) {
-				int potentialInput = redirectionTester(info); // retrieves potential input redirection
-				if (potentialInput == -1) { // tests and implements input redirection
-					exit(0); // exits preemptively before commands are run
-				}
-				new_desc = 0; // sets the starting input to standard input or potential input redirection
-				if (info->pipeNum > 0) {
-					int i;
-					for (i=0; i < info->pipeNum; ++i) {
-						pipe(fds);
-						pipingHandler((&(info->CommArray[i]))->VarList, new_desc, fds[1]);
-						close(fds[1]);
-						new_desc = fds[0];
-					}
-					if (new_desc != 0)
-						dup2(new_desc, 0);
-					executeCommand((&(info->CommArray[i]))->command, (&(info->CommArray[i]))->VarList); //calls execvp
-				} else {
-					executeCommand(com->command, com->VarList); //calls execvp
+			input.end += got;
+		}
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: syncInput()
+DESCRIPTION: when batch input is read from standard input, the commands it
+starts share that descriptor with the shell. For a seekable input the offset
+is moved back to the end of the current line, so they see the rest of the
+input instead of whatever the shell had not buffered yet. Pipes cannot be
+rewound, so commands reading a piped script's standard input see only what
+lies beyond the shell's buffer.
+-------------------------------------------------------------------------------*/
+void syncInput() {
+	off_t unread = input.end - input.start;
+	if (input.buf == NULL || input.fd != STDIN_FILENO || unread == 0) {
+		return;
+	}
+	if (lseek(input.fd, -unread, SEEK_CUR) != -1) {
+		input.start = input.end = 0;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int timeKeyword(struct commandType *com)
+DESCRIPTION: recognizes the time keyword as the first word of a pipeline, with
+its -p (POSIX) and -j (JSON) options, before the words are expanded. Removes
+them from the words of the first command and returns the report format, or
+returns TIME_NONE. A quoted 'time' is an ordinary command.
+-------------------------------------------------------------------------------*/
+int timeKeyword(struct commandType *com) {
+	int format, n = 1;
+
+	if (com->VarNum == 0 || strcmp(com->VarList[0], "time") != 0) {
+		return TIME_NONE;
+	}
+	format = TIME_HUMAN;
+	for (; n < com->VarNum; n++) {
+		if (strcmp(com->VarList[n], "-p") == 0) {
+			format = TIME_POSIX;
+		} else if (strcmp(com->VarList[n], "-j") == 0) {
+			format = TIME_JSON;
+		} else {
+			break;
+		}
+	}
+	com->VarList += n; // expandCommand() sees the new first word and resolves it again
+	com->VarNum -= n;
+	com->VarCap -= n;
+	return format;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: double seconds(struct timeval tv)
+DESCRIPTION: a struct timeval as a number of seconds
+-------------------------------------------------------------------------------*/
+double seconds(struct timeval tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: double elapsed(struct timespec *start, struct timespec *end)
+DESCRIPTION: the seconds from start to end
+-------------------------------------------------------------------------------*/
+double elapsed(struct timespec *start, struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: printClock(FILE *out, const char *name, double secs)
+DESCRIPTION: one "name<TAB>XmY.YYYs" line of a time report
+-------------------------------------------------------------------------------*/
+void printClock(FILE *out, const char *name, double secs) {
+	int minutes = (int) (secs / 60);
+	fprintf(out, "%s\t%dm%.3fs\n", name, minutes, secs - 60 * minutes);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: printJsonString(FILE *out, const char *s)
+DESCRIPTION: writes s as a JSON string, quotes included
+-------------------------------------------------------------------------------*/
+void printJsonString(FILE *out, const char *s) {
+	putc('"', out);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			fprintf(out, "\\%c", *s);
+		} else if ((unsigned char) *s < 0x20) {
+			fprintf(out, "\\u%04x", (unsigned char) *s);
+		} else {
+			putc(*s, out);
+		}
+	}
+	putc('"', out);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: printUsage(FILE *out, int format, double real, struct rusage *usage)
+DESCRIPTION: one row of a time report: the wall time, the user and system
+time, the max RSS in KiB, the page faults and the context switches, either as
+table columns or as JSON members
+-------------------------------------------------------------------------------*/
+void printUsage(FILE *out, int format, double real, struct rusage *usage) {
+	if (format == TIME_JSON) {
+		fprintf(out, "\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,"
+			"\"minflt\":%ld,\"majflt\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld",
+			real, seconds(usage->ru_utime), seconds(usage->ru_stime), usage->ru_maxrss,
+			usage->ru_minflt, usage->ru_majflt, usage->ru_nvcsw, usage->ru_nivcsw);
+	} else {
+		fprintf(out, "%.3f\t%.3f\t%.3f\t%ld\t%ld\t%ld\t%ld\t%ld",
+			real, seconds(usage->ru_utime), seconds(usage->ru_stime), usage->ru_maxrss,
+			usage->ru_minflt, usage->ru_majflt, usage->ru_nvcsw, usage->ru_nivcsw);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: reportTimes(FILE *out, int format, parseInfo *info, pid_t *pids,
+	int *statuses, struct stageTimes *times, struct timespec *start,
+	struct timespec *end)
+DESCRIPTION: the report of the time keyword, for a pipeline that ran from start
+to end. The totals sum the times, faults and context switches of the stages
+and take the largest max RSS. TIME_HUMAN shows the totals the way other shells
+do followed by a table of the stages, TIME_POSIX only the three totals in the
+format POSIX asks for, and TIME_JSON everything as one JSON object per line.
+-------------------------------------------------------------------------------*/
+void reportTimes(FILE *out, int format, parseInfo *info, pid_t *pids, int *statuses,
+		struct stageTimes *times, struct timespec *start, struct timespec *end) {
+	struct rusage total;
+	double real = elapsed(start, end);
+	int i, n = info->pipeNum + 1;
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < n; i++) {
+		addUsage(&total, &times[i].usage);
+	}
+
+	if (format == TIME_POSIX) {
+		fprintf(out, "real %.2f\nuser %.2f\nsys %.2f\n",
+			real, seconds(total.ru_utime), seconds(total.ru_stime));
+	} else if (format == TIME_JSON) {
+		fprintf(out, "{");
+		printUsage(out, format, real, &total);
+		fprintf(out, ",\"status\":%d,\"stages\":[", exitCode(statuses[n - 1]));
+		for (i = 0; i < n; i++) {
+			fprintf(out, "%s{\"command\":", i ? "," : "");
+			printJsonString(out, info->CommArray[i].command ? info->CommArray[i].command : "");
+			fprintf(out, ",\"pid\":%d,\"status\":%d,", pids[i], exitCode(statuses[i]));
+			printUsage(out, format, elapsed(start, &times[i].end), &times[i].usage);
+			fprintf(out, "}");
+		}
+		fprintf(out, "]}\n");
+	} else {
+		fprintf(out, "\n");
+		printClock(out, "real", real);
+		printClock(out, "user", seconds(total.ru_utime));
+		printClock(out, "sys", seconds(total.ru_stime));
+		fprintf(out, "stage\treal\tuser\tsys\tmaxrss\tminflt\tmajflt\tvcsw\tivcsw\tcommand\n");
+		for (i = 0; i < n; i++) {
+			fprintf(out, "%d\t", i + 1);
+			printUsage(out, format, elapsed(start, &times[i].end), &times[i].usage);
+			fprintf(out, "\t%s%s\n", info->CommArray[i].command ? info->CommArray[i].command : "",
+				pids[i] > 0 ? "" : " (shell)");
+		}
+	}
+	fflush(out);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: expandCommand(struct commandType *stage)
+DESCRIPTION: expands every word of a stage and removes its quotes, dropping the
+words that expand to nothing and replacing those with unquoted wildcards by the
+paths they match, if any. If the command name itself changed, whether it is a
+builtin is decided again for the new name. The file names of its redirections
+and its here-strings are expanded too, but not globbed, and so are the bodies
+of here-documents whose delimiter was not quoted. Returns -1 if a redirection
+is left without a file name.
+-------------------------------------------------------------------------------*/
+int expandCommand(struct commandType *stage) {
+	char **words = stage->VarList; // the words as parsed, read while the new list is built
+	char **matches, **grown, *word, *pattern;
+	int i, kept = 0, removed, n, cap;
+
+	for (i = 0; i < stage->VarNum; i++) {
+		word = expand_word(words[i], &lineArena, &removed, &pattern);
+		if (removed) {
+			continue;
+		}
+		n = pattern != NULL ? yglob_expand(pattern, &lineArena, &matches) : 0;
+		if (n == 0) {
+			stage->VarList[kept++] = word;
+			continue;
+		}
+		// the list shrinks in place, and moves to the arena the first time it grows
+		if (stage->VarList == words || kept + n + stage->VarNum - i > stage->VarCap) {
+			cap = 2 * (kept + n + stage->VarNum - i);
+			grown = arena_alloc(&lineArena, cap * sizeof(char *));
+			if (grown == NULL) {
+				stage->VarList[kept++] = word;
+				continue;
+			}
+			memcpy(grown, stage->VarList, kept * sizeof(char *));
+			stage->VarList = grown;
+			stage->VarCap = cap;
+		}
+		memcpy(stage->VarList + kept, matches, n * sizeof(char *));
+		kept += n;
+	}
+	stage->VarList[kept] = NULL;
+	stage->VarNum = kept;
+	if (kept == 0) {
+		stage->command = NULL;
+		stage->builtin = NO_SUCH_BUILTIN;
+	} else if (stage->VarList[0] != stage->command) {
+		stage->command = stage->VarList[0];
+		stage->builtin = isBuiltInCommand(stage->command);
+	}
+
+	struct redirect *r;
+	for (r = stage->redirs; r != NULL; r = r->next) {
+		if (r->type == REDIR_HEREDOC) {
+			if (!r->quoted) {
+				r->body = expand_heredoc(r->body, &lineArena);
+			}
+		} else if (r->word != NULL) {
+			r->word = expand_word(r->word, &lineArena, &removed, NULL);
+			if (r->type != REDIR_HERESTRING && (removed || r->word[0] == '\0')) {
+				fprintf(stderr, "Missing name for redirect.\n");
+				return -1;
+			} else if (removed) {
+				r->word = "";
+			}
+		}
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: char *readHereLine()
+DESCRIPTION: the next line of a here-document: from readline with a "> "
+prompt when the shell is interactive, from the batch input otherwise. The
+line is only valid until the next call. Returns NULL at the end of the input.
+-------------------------------------------------------------------------------*/
+char *readHereLine() {
+	static char *last = NULL;
+
+	if (!interactive) {
+		return readInputLine();
+	}
+	free(last);
+	last = readline("> ");
+	return last;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int readHereDocuments(commandList *list)
+DESCRIPTION: reads the bodies of the here-documents of a line, in the order
+their << appear, from the lines that follow it up to each delimiter. The
+delimiter has its quotes removed; if it had any, the body is taken as it is
+rather than expanded. A body cut short by the end of the input is kept, with a
+warning. The bodies live in lineArena. Returns -1 if memory ran out.
+-------------------------------------------------------------------------------*/
+int readHereDocuments(commandList *list) {
+	static char *body = NULL; // reused from one here-document to the next
+	static size_t size = 0;
+	struct redirect *r;
+	char *delim, *line;
+	size_t len, n;
+	int i, j;
+
+	for (i = 0; i < list->count; i++) {
+		parseInfo *info = list->entries[i].pipeline;
+		for (j = 0; j <= info->pipeNum; j++) {
+			for (r = info->CommArray[j].redirs; r != NULL; r = r->next) {
+				if (r->type != REDIR_HEREDOC) {
+					continue;
 				}
-			} else {
-				if (info->boolBackground)  {
-					int i = 0;
-					int numjobs = 1;
-					char *fullcommand = (char *) malloc(NAME_MAX);
-					struct job *newjob = (struct job*) malloc(sizeof(struct job)); // creates a job object newjob
-					strcpy(fullcommand, "");
-					while(com->VarList[i] != NULL) {
-						strcat(fullcommand, com->VarList[i]);
-						strcat(fullcommand, " ");
-						i++;
-					}
-					newjob->command = fullcommand; // stores the values to the new object
-					
-					newjob->pid = childPid;
-					newjob->mode = 0;
-					newjob->nextjob = NULL;
-					if (head != NULL) { // determines if there are any jobs running
-						struct job *tempjob = (struct job*) malloc(sizeof(struct job)); // tempjob for finding size
-						for (tempjob = head; tempjob != NULL; tempjob = tempjob->nextjob) {
-							numjobs++; // finds the current jobID
-							if (tempjob->nextjob == NULL) {
-								tempjob->nextjob = newjob;
-								break;
-							}
+				delim = expand_delimiter(r->word, &lineArena, &r->quoted);
+				len = 0;
+				while ((line = readHereLine()) != NULL && strcmp(line, delim) != 0) {
+					n = strlen(line);
+					if (len + n + 2 > size) {
+						size = 2 * (len + n + 2);
+						body = stat_alloc(realloc(body, size));
+						if (body == NULL) {
+							size = 0;
+							return -1;
 						}
-						newjob->num = numjobs;
-					} else { // sets head to the only job
-						newjob->num = 1;
-						head = newjob;
-						continue;
-					}
-					continue;
-				} else {
-					waitpid(childPid, &status, 0);
-					if (WIFSIGNALED(status)){
-						fprintf(stderr, "Error\n");
 					}
+					memcpy(body + len, line, n);
+					len += n;
+					body[len++] = '\n';
+				}
+				if (line == NULL) {
+					fprintf(stderr, "yosh: here-document ended by end of file (wanted '%s')\n", delim);
 				}
+				r->body = arena_alloc(&lineArena, len + 1);
+				if (r->body == NULL) {
+					return -1;
+				}
+				memcpy(r->body, body == NULL ? "" : body, len);
+				r->body[len] = '\0';
+			}
+		}
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int captureJobOutput(parseInfo *info, int *fds)
+DESCRIPTION: with -b, opens the pipe the output of a background pipeline is
+captured through into fds, its read end non-blocking, and puts redirections of
+standard error, and of standard output where it is not a pipe, onto it in
+front of those of every stage, so that a stage's own redirections still win.
+Returns -1 after printing why if the pipe could not be opened.
+-------------------------------------------------------------------------------*/
+int captureJobOutput(parseInfo *info, int *fds) {
+	struct commandType *stage;
+	struct redirect *r;
+	int i, fd;
+
+	if (pipe2(fds, O_CLOEXEC) == -1) {
+		perror("pipe");
+		return -1;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	for (i = 0; i <= info->pipeNum; i++) {
+		stage = &info->CommArray[i];
+		for (fd = 2; fd >= 1; fd--) {
+			if (fd == 1 && i < info->pipeNum && (stage->branch == 0 ||
+					info->CommArray[i + 1].branch == stage->branch)) {
+				continue; // writes into the next stage or the pump of a |& group
+			}
+			r = arena_alloc(&lineArena, sizeof(struct redirect));
+			if (r == NULL) {
+				close(fds[0]);
+				close(fds[1]);
+				fprintf(stderr, "Out of memory.\n");
+				return -1;
+			}
+			memset(r, 0, sizeof(*r));
+			r->type = REDIR_DUP;
+			r->fd = fd;
+			r->target = fds[1];
+			r->next = stage->redirs;
+			if (stage->redirs == NULL) {
+				stage->lastRedir = r;
+			}
+			stage->redirs = r;
+		}
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: runPipeline(parseInfo *info)
+DESCRIPTION: expands and runs one pipeline of a line, in the foreground or the
+background. Returns its status, which is also remembered in lastStatus; a
+pipeline that expanded to nothing leaves lastStatus as it was.
+-------------------------------------------------------------------------------*/
+int runPipeline(parseInfo *info) {
+	struct commandType *com; // com stores command name and Arg list for one command.
+	int status = 0; // A pointer to the location where status information for the terminating process is to be stored
+	int timeFormat; // the time keyword's report format, or TIME_NONE
+	struct timespec start, end;
+	statTime phaseStart;
+
+	// prints the info struct
+	//print_info(info);
+
+	com = &info->CommArray[0];
+	timeFormat = timeKeyword(com);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	//insert your code here / commands etc.
+	int i;
+	phaseStart = stat_clock();
+	expand_set_status(lastStatus);
+	for (i = 0; i <= info->pipeNum; i++) {
+		if (expandCommand(&info->CommArray[i]) == -1) {
+			stat_phase(STAT_EXPAND, phaseStart);
+			return lastStatus = 1;
+		}
+	}
+	stat_phase(STAT_EXPAND, phaseStart);
+
+	//com contains the info. of the command before the first "|"
+	
+	if ((com == NULL) || (com->command == NULL)) {
+		return lastStatus;
+	}
+		
+	//com->command tells the command name of com
+	else if (info->pipeNum == 0 && com->builtin != NO_SUCH_BUILTIN && !info->boolBackground) {
+		struct rusage before;
+		int *saved = NULL;
+		if (timeFormat != TIME_NONE) {
+			getrusage(RUSAGE_SELF, &before);
+		}
+		if (com->redirs != NULL && (openHereDocuments(info) == -1 ||
+				(saved = redirectBuiltin(com->redirs)) == NULL)) {
+			closeHereDocuments(info);
+			return lastStatus = 1;
+		}
+		phaseStart = stat_clock();
+		status = W_EXITCODE(executeBuiltInCommand(com->builtin, com->VarList, stdout), 0); // runs in the shell itself
+		fflush(stdout);
+		stat_phase(STAT_BUILTIN, phaseStart);
+		if (saved != NULL) { // the shell gets its own descriptors back
+			restoreRedirections(com->redirs, saved);
+			closeHereDocuments(info);
+		}
+		if (timeFormat != TIME_NONE) { // the usage of the shell while the builtin ran
+			struct stageTimes times;
+			pid_t pid = 0;
+			getrusage(RUSAGE_SELF, &times.usage);
+			timersub(&times.usage.ru_utime, &before.ru_utime, &times.usage.ru_utime);
+			timersub(&times.usage.ru_stime, &before.ru_stime, &times.usage.ru_stime);
+			times.usage.ru_minflt -= before.ru_minflt;
+			times.usage.ru_majflt -= before.ru_majflt;
+			times.usage.ru_nvcsw -= before.ru_nvcsw;
+			times.usage.ru_nivcsw -= before.ru_nivcsw;
+			clock_gettime(CLOCK_MONOTONIC, &times.end);
+			reportTimes(stderr, timeFormat, info, &pid, &status, &times, &start, &times.end);
+		}
+	} else {
+		pid_t *pids = arena_alloc(&lineArena, (info->pipeNum + 1) * sizeof(pid_t));
+		int *statuses = arena_alloc(&lineArena, (info->pipeNum + 1) * sizeof(int));
+		struct stageTimes *times = NULL;
+		pid_t pgid;
+
+		int capture[2] = { -1, -1 }; // with -b, the pipe a background pipeline writes to
+
+		if (info->boolBackground && jobOutput != -1 && captureJobOutput(info, capture) == -1) {
+			return lastStatus = 1;
+		}
+		syncInput(); // commands reading standard input must not miss what the shell buffered
+		sigprocmask(SIG_BLOCK, &chldMask, NULL); // nothing is drained before the stages are recorded
+		phaseStart = stat_clock();
+		if (timeFormat != TIME_NONE && !info->boolBackground) {
+			times = arena_alloc(&lineArena, (info->pipeNum + 1) * sizeof(struct stageTimes));
+			memset(times, 0, (info->pipeNum + 1) * sizeof(struct stageTimes));
+		}
+		pgid = launchPipeline(info, pids, statuses, times, !info->boolBackground);
+		stat_phase(STAT_LAUNCH, phaseStart);
+		if (capture[1] != -1) {
+			close(capture[1]); // the stages have their copies
+		}
+		if (pgid == -1) {
+			sigprocmask(SIG_SETMASK, &origMask, NULL);
+			if (capture[0] != -1) {
+				close(capture[0]);
+			}
+			status = 1 << 8;
+		} else if (info->boolBackground)  {
+			int i = 0;
+			size_t length = 1;
+			for (i = 0; i < com->VarNum; i++) {
+				length += strlen(com->VarList[i]) + 1;
+			}
+			char *fullcommand = (char *) stat_alloc(malloc(length));
+			strcpy(fullcommand, "");
+			i = 0;
+			while(com->VarList[i] != NULL) {
+				strcat(fullcommand, com->VarList[i]);
+				strcat(fullcommand, " ");
+				i++;
+			}
+			struct job *newjob = addJob(fullcommand, pids, info->pipeNum + 1);
+			if (capture[0] != -1) {
+				watchJobOutput(newjob, capture[0]);
+			}
+			sigprocmask(SIG_SETMASK, &origMask, NULL);
+		} else {
+			if (times != NULL && pids[0] == 0) {
+				clock_gettime(CLOCK_MONOTONIC, &times[0].end); // a builtin that ran in the shell is done by now
+			}
+			phaseStart = stat_clock();
+			waitPipeline();
+			stat_phase(STAT_WAIT, phaseStart);
+			sigprocmask(SIG_SETMASK, &origMask, NULL);
+			if (times != NULL) {
+				clock_gettime(CLOCK_MONOTONIC, &end);
+				reportTimes(stderr, timeFormat, info, pids, statuses, times, &start, &end);
+			}
+			status = statuses[info->pipeNum];
+			if (WIFSIGNALED(status)){
+				fprintf(stderr, "Error\n");
+			}
+		}
+	}
+
+	return lastStatus = exitCode(status);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: runCommandLine(char *cmdLine)
+DESCRIPTION: parses and runs one line of input, whether it came from readline
+or from a script. The pipelines of the line run in order; the one after && only
+runs if the status so far is 0 and the one after || only if it is not, so a
+pipeline that is skipped passes the status on. The line itself is not modified
+or freed. Returns the status of the line, which is also remembered in
+lastStatus.
+-------------------------------------------------------------------------------*/
+int runCommandLine(char *cmdLine) {
+	commandList *list;
+	statTime phaseStart;
+	int i, op;
+
+	// calls the parser, everything it returns lives in lineArena until the next line
+	arena_reset(&lineArena);
+	stat_count(STAT_LINES);
+	phaseStart = stat_clock();
+	list = parse_list(cmdLine, &lineArena);
+	stat_phase(STAT_PARSE, phaseStart);
+	if (list == NULL) {
+		return lastStatus = 2;
+	}
+	if (readHereDocuments(list) == -1) {
+		fprintf(stderr, "Out of memory.\n");
+		return lastStatus = 1;
+	}
+
+	for (i = 0; i < list->count; i++) {
+		op = i > 0 ? list->entries[i - 1].op : LIST_SEQ;
+		if ((op == LIST_AND && lastStatus != 0) || (op == LIST_OR && lastStatus == 0)) {
+			continue;
+		}
+		runPipeline(list->entries[i].pipeline);
+	}
+	return lastStatus;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: int readKey(FILE *stream)
+DESCRIPTION: the readline getc function with -b. While readline waits for the
+next key, the output of background jobs keeps being read into their rings, so
+that a job writing a lot does not stop on a full pipe at the prompt. Signals
+that interrupt the wait are handed to readline as its own getc would.
+-------------------------------------------------------------------------------*/
+int readKey(FILE *stream) {
+	struct pollfd fds[2];
+
+	fds[0].fd = fileno(stream);
+	fds[0].events = POLLIN;
+	fds[1].fd = jobOutput;
+	fds[1].events = POLLIN;
+	while (1) {
+		if (poll(fds, 2, -1) == -1) {
+			if (errno != EINTR) {
+				break; // rl_getc() reports it
+			}
+			rl_check_signals();
+			continue;
+		}
+		if (fds[1].revents & POLLIN) {
+			drainJobOutput();
+		}
+		if (fds[0].revents != 0) {
+			break;
+		}
+	}
+	return rl_getc(stream);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION: main()
+DESCRIPTION: the main command of the terminal -- initialization is contained
+within this command as well. With no arguments and a terminal on standard
+input the shell is interactive and reads commands with readline. Otherwise it
+runs in batch mode, without readline, prompts or history:
+	yosh -c 'command line'		runs the given lines
+	yosh script.ysh			runs the lines of the script file
+	command | yosh			runs the lines read from standard input
+In batch mode the shell exits with the status of the last line it ran.
+-l fork or -l spawn picks how external commands are started, spawn being the
+default.
+-b captures the standard output and error of background jobs into a ring of
+the last JOB_OUTPUT_SIZE bytes of each, shown with jobs -o %num, instead of
+letting them write to the terminal.
+-------------------------------------------------------------------------------*/
+int main(int argc, char **argv) {
+	arena_init(&lineArena);
+	parse_set_builtin_resolver(isBuiltInCommand);
+	parse_set_alloc_counter(stat_count_alloc); // the arena counts its chunks with the shell's own allocations
+	
+	char *cmdLine;
+	char *commandString = NULL;
+	int opt;
+
+	int captureJobs = 0;
+
+	while ((opt = getopt(argc, argv, "+bc:l:")) != -1) {
+		switch (opt) {
+		case 'b':
+			captureJobs = 1;
+			break;
+		case 'c':
+			commandString = optarg;
+			break;
+		case 'l':
+			if (strcmp(optarg, "fork") == 0) {
+				launcher = LAUNCH_FORK;
+			} else if (strcmp(optarg, "spawn") == 0) {
+				launcher = LAUNCH_SPAWN;
+			} else {
+				fprintf(stderr, "yosh: -l: unknown launcher %s, use fork or spawn\n", optarg);
+				exit(2);
 			}
+			break;
+		default:
+			fprintf(stderr, "Usage: yosh [-b] [-l fork|spawn] [-c command | script]\n");
+			exit(2);
+		}
+	}
+
+	if (getenv("YOSH_STATS") != NULL && *getenv("YOSH_STATS") != '\0') {
+		stat_write_on_exit(getenv("YOSH_STATS"));
+	}
+
+	sigemptyset(&chldMask);
+	sigaddset(&chldMask, SIGCHLD);
+	sigprocmask(SIG_SETMASK, NULL, &origMask);
+	if (pipe2(selfPipe, O_NONBLOCK|O_CLOEXEC) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	signal(SIGCHLD, handle_sigchld);
+	signal(SIGPIPE, SIG_IGN); // a builtin writing into a pipeline must not kill the shell
+	if (captureJobs && (jobOutput = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		perror("epoll_create1");
+		exit(1);
+	}
+
+	if (commandString != NULL) {
+		openInput(-1, commandString);
+	} else if (optind < argc) {
+		int fd = open(argv[optind], O_RDONLY|O_CLOEXEC);
+		if (fd == -1) {
+			perror(argv[optind]);
+			exit(127);
+		}
+		openInput(fd, NULL);
+	} else if (!isatty(STDIN_FILENO)) {
+		openInput(STDIN_FILENO, NULL);
+	} else {
+		interactive = 1;
+		signal(SIGTTOU, SIG_IGN); // lets the shell hand the terminal to its jobs and take it back
+	}
+
+	if (!interactive) {
+		statTime readStart = stat_clock();
+		while ((cmdLine = readInputLine()) != NULL) {
+			stat_phase(STAT_READ, readStart);
+			runCommandLine(cmdLine);
+			readStart = stat_clock();
+		}
+		exit(lastStatus);
+	}
+
+	fprintf(stdout, "This is the YOSH version 0.1\n");
+	using_history();
+	openHistory();
+	if (jobOutput != -1) {
+		rl_getc_function = readKey;
+	}
+
+	while (1) {
+		// insert your code here
+
+		drainChildEvents();
+		drainJobOutput(); // what the jobs that finished wrote last, before they are reported
+		notifyJobs();
+		if (sharedHistory) {
+			loadHistory();
+		}
+		statTime phaseStart = stat_clock();
+		cmdLine = readline(prompt_get(jobTable.count, lastStatus));
+		stat_phase(STAT_READ, phaseStart);
+		if (cmdLine == NULL) {
+			fprintf(stderr, "Unable to read command\n");
+			continue;
+		}
+
+		// insert your code about history and !x !-x here
+		char *buffer;
+		phaseStart = stat_clock();
+		int result = history_expand(cmdLine, &buffer);
+		stat_phase(STAT_HISTEXPAND, phaseStart);
+		if (result < 0 || result == 2) { // an expansion error, or :p asking only to print
+			fprintf (stderr, "%s\n", buffer);
+			free(buffer);
+			free(cmdLine);
+			continue;
 		}
-		free_info(info);
+		if (!sharedHistory) {
+			add_history(buffer);
+			hist_append(buffer, time(NULL));
+		} else if (hist_append(buffer, time(NULL)) == -1) {
+			add_history(buffer); // it will not come back from the file
+		} // otherwise loadHistory() reads it back, in file order, before the next prompt
+		if (result)
+	    	fprintf (stderr, "%s\n", buffer);
+
+		runCommandLine(buffer);
+		free(buffer);
 		free(cmdLine);
 
 	} /* while(1) */